@@ -41,6 +41,15 @@ RT_C_DECLS_BEGIN
  * The deal is that there is exactly one writer and one reader.
  * When offRead equals offWrite the buffer is empty. In the other
  * extreme the writer will not use the last free byte in the buffer.
+ *
+ * Defining INTNET_RING_SPLIT_LAYOUT selects a layout keeping the constant
+ * members, the writer owned members and the reader owned members on separate
+ * cache lines, so the two sides don't keep stealing the same line from each
+ * other for every frame. Each side also keeps a private copy of the other
+ * side's offset and only reads the real one when the ring looks full (writer)
+ * or empty (reader). The buffer is shared with VMMR0 and ring-3, so every
+ * party mapping it must be built with the same setting; the default is the
+ * packed layout. INTNETBUF_MAGIC tells the two apart.
  */
 typedef struct INTNETRINGBUF
 {
@@ -48,6 +57,49 @@ typedef struct INTNETRINGBUF
     uint32_t            offStart;
     /** The offset from this structure to the end of the buffer. (exclusive). */
     uint32_t            offEnd;
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    /** Alignment padding, the above members are read-only after init. */
+    uint32_t            au32Align0[14];
+
+    /** @name Writer owned members.
+     * @{ */
+    /** The committed write offset. */
+    uint32_t volatile   offWriteCom;
+    /** Writer internal current write offset.
+     * This is ahead of offWriteCom when buffer space is handed to a third party for
+     * data gathering.  offWriteCom will be assigned this value by the writer then
+     * the frame is ready. */
+    uint32_t volatile   offWriteInt;
+    /** The writer's copy of offReadX.  This is never ahead of offReadX and is
+     * refreshed when a frame doesn't fit. */
+    uint32_t            offReadCache;
+    /** Alignment. */
+    uint32_t            u32Align1;
+    /** The number of bytes written (not counting overflows). */
+    STAMCOUNTER         cbStatWritten;
+    /** The number of frames written (not counting overflows). */
+    STAMCOUNTER         cStatFrames;
+    /** The number of overflows. */
+    STAMCOUNTER         cOverflows;
+    /** Alignment padding. */
+    uint64_t            au64Align2[3];
+    /** @} */
+
+    /** @name Reader owned members.
+     * @{ */
+    /** The current read offset. */
+    uint32_t volatile   offReadX;
+    /** The reader's copy of offWriteCom.  This is never ahead of offWriteCom
+     * and is refreshed when the ring looks empty. */
+    uint32_t            offWriteComCache;
+    /** Alignment padding. */
+    uint32_t            au32Align3[14];
+    /** @} */
+} INTNETRINGBUF;
+AssertCompileSize(INTNETRINGBUF, 192);
+AssertCompileMemberOffset(INTNETRINGBUF, offWriteCom, 64);
+AssertCompileMemberOffset(INTNETRINGBUF, offReadX, 128);
+#else  /* !INTNET_RING_SPLIT_LAYOUT */
     /** The current read offset. */
     uint32_t volatile   offReadX;
     /** Alignment. */
@@ -68,6 +120,7 @@ typedef struct INTNETRINGBUF
     STAMCOUNTER         cOverflows;
 } INTNETRINGBUF;
 AssertCompileSize(INTNETRINGBUF, 48);
+#endif /* !INTNET_RING_SPLIT_LAYOUT */
 /** Pointer to a ring buffer. */
 typedef INTNETRINGBUF *PINTNETRINGBUF;
 
@@ -119,6 +172,26 @@ typedef struct INTNETBUF
     uint32_t        cbSend;
     /** The size of the receive area. */
     uint32_t        cbRecv;
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    /** Number of times yields help solve an overflow. */
+    STAMCOUNTER     cStatYieldsOk;
+    /** Number of times yields didn't help solve an overflow. */
+    STAMCOUNTER     cStatYieldsNok;
+    /** Number of lost packets due to overflows. */
+    STAMCOUNTER     cStatLost;
+    /** Number of bad frames (both rings). */
+    STAMCOUNTER     cStatBadFrames;
+    /** Reserved for future use. */
+    STAMCOUNTER     aStatReserved[2];
+    /** The receive buffer. */
+    INTNETRINGBUF   Recv;
+    /** The send buffer. */
+    INTNETRINGBUF   Send;
+} INTNETBUF;
+AssertCompileSize(INTNETBUF, 448);
+AssertCompileMemberOffset(INTNETBUF, Recv, 64);
+AssertCompileMemberOffset(INTNETBUF, Send, 256);
+#else  /* !INTNET_RING_SPLIT_LAYOUT */
     /** The receive buffer. */
     INTNETRINGBUF   Recv;
     /** The send buffer. */
@@ -137,14 +210,24 @@ typedef struct INTNETBUF
 AssertCompileSize(INTNETBUF, 160);
 AssertCompileMemberOffset(INTNETBUF, Recv, 16);
 AssertCompileMemberOffset(INTNETBUF, Send, 64);
+#endif /* !INTNET_RING_SPLIT_LAYOUT */
 
 /** Pointer to an interface buffer. */
 typedef INTNETBUF *PINTNETBUF;
 /** Pointer to a const interface buffer. */
 typedef INTNETBUF const *PCINTNETBUF;
 
-/** Magic number for INTNETBUF::u32Magic (Sir William Gerald Golding). */
-#define INTNETBUF_MAGIC             UINT32_C(0x19110919)
+/** Magic number for INTNETBUF::u32Magic, split ring layout (Doris May Lessing). */
+#define INTNETBUF_MAGIC_SPLIT       UINT32_C(0x19191022)
+/** Magic number for INTNETBUF::u32Magic, legacy packed ring layout
+ * (Sir William Gerald Golding). */
+#define INTNETBUF_MAGIC_LEGACY      UINT32_C(0x19110919)
+/** Magic number for INTNETBUF::u32Magic of the layout we're compiled for. */
+#ifdef INTNET_RING_SPLIT_LAYOUT
+# define INTNETBUF_MAGIC            INTNETBUF_MAGIC_SPLIT
+#else
+# define INTNETBUF_MAGIC            INTNETBUF_MAGIC_LEGACY
+#endif
 
 /**
  * Asserts the sanity of the specified INTNETBUF structure.
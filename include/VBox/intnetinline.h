@@ -38,6 +38,28 @@
 #include <VBox/log.h>
 
 
+/** @def INTNETSG_PREFETCH
+ * Hints the CPU to start fetching the cache line at @a pv, used to get the
+ * next segment on its way while the current one is being copied. */
+#if defined(__GNUC__)
+# define INTNETSG_PREFETCH(pv)          __builtin_prefetch(pv)
+#else
+# define INTNETSG_PREFETCH(pv)          do { } while (0)
+#endif
+
+/** @def INTNETSG_WITH_NT_COPY
+ * Defined when IntNetSgReadNt can use non-temporal stores (MOVNTI).  These
+ * only need the general purpose registers, so they are safe in ring-0 without
+ * saving the FPU/SSE state. */
+#if defined(RT_ARCH_AMD64) && RT_INLINE_ASM_GNU_STYLE
+# define INTNETSG_WITH_NT_COPY
+#endif
+
+/** Frames of this size and larger are copied with non-temporal stores by
+ *  IntNetSgReadNt.  Standard sized frames stay in the cache, jumbo and GSO
+ *  frames don't wipe it. */
+#define INTNETSG_NT_COPY_THRESHOLD      _4K
+
 
 /**
  * Valid internal networking frame type.
@@ -55,6 +77,24 @@ DECLINLINE(bool) IntNetIsValidFrameType(uint16_t u16Type)
 }
 
 
+/**
+ * Calculates the hash of an interface name (sdbm).
+ *
+ * Used by the trunk drivers for their name lookup tables.
+ *
+ * @returns The hash value, the caller masks it to the table size.
+ * @param   pszName             The interface name.
+ */
+DECLINLINE(uint32_t) IntNetNameHash(const char *pszName)
+{
+    uint32_t uHash = 0;
+    uint8_t  ch;
+    while ((ch = (uint8_t)*pszName++) != '\0')
+        uHash = ch + (uHash << 6) + (uHash << 16) - uHash;
+    return uHash;
+}
+
+
 /**
  * Partly initializes a scatter / gather buffer, leaving the segments to the
  * caller.
@@ -172,21 +212,25 @@ DECLINLINE(void) IntNetSgInitTempGso(PINTNETSG pSG, void *pvFrame, uint32_t cbFr
  */
 DECLINLINE(void) IntNetSgRead(PCINTNETSG pSG, void *pvBuf)
 {
-    memcpy(pvBuf, pSG->aSegs[0].pv, pSG->aSegs[0].cb);
     if (pSG->cSegsUsed == 1)
+    {
+        memcpy(pvBuf, pSG->aSegs[0].pv, pSG->aSegs[0].cb);
         Assert(pSG->cbTotal == pSG->aSegs[0].cb);
+    }
     else
     {
-        uint8_t        *pbDst = (uint8_t *)pvBuf + pSG->aSegs[0].cb;
+        uint8_t        *pbDst = (uint8_t *)pvBuf;
         unsigned        iSeg  = 0;
         unsigned const  cSegs = pSG->cSegsUsed;
-        while (++iSeg < cSegs)
+        do
         {
             uint32_t    cbSeg = pSG->aSegs[iSeg].cb;
             Assert((uintptr_t)pbDst - (uintptr_t)pvBuf + cbSeg <= pSG->cbTotal);
+            if (iSeg + 1 < cSegs)
+                INTNETSG_PREFETCH(pSG->aSegs[iSeg + 1].pv);
             memcpy(pbDst, pSG->aSegs[iSeg].pv, cbSeg);
             pbDst += cbSeg;
-        }
+        } while (++iSeg < cSegs);
     }
 }
 
@@ -243,6 +287,8 @@ DECLINLINE(void) IntNetSgReadEx(PCINTNETSG pSG, uint32_t offSrc, uint32_t cbToRe
             return;
         }
 
+        if (iSeg + 1 < pSG->cSegsUsed)
+            INTNETSG_PREFETCH(pSG->aSegs[iSeg + 1].pv);
         memcpy(pbDst, pSG->aSegs[iSeg].pv, cbSeg);
         pbDst    += cbSeg;
         cbToRead -= cbSeg;
@@ -251,11 +297,307 @@ DECLINLINE(void) IntNetSgReadEx(PCINTNETSG pSG, uint32_t offSrc, uint32_t cbToRe
     }
 }
 
+
+#ifdef INTNETSG_WITH_NT_COPY
+/**
+ * Copies a chunk of memory using non-temporal stores for the bulk of it.
+ *
+ * The caller must issue a store fence before the data is handed to anyone
+ * else.
+ *
+ * @param   pbDst       The destination.
+ * @param   pbSrc       The source.
+ * @param   cb          The number of bytes to copy.
+ */
+DECLINLINE(void) intnetSgCopyNt(uint8_t *pbDst, uint8_t const *pbSrc, uint32_t cb)
+{
+    /* Align the destination on a qword boundrary. */
+    uint32_t cbHead = (uint32_t)(-(uintptr_t)pbDst & 7);
+    if (cbHead)
+    {
+        if (cbHead > cb)
+            cbHead = cb;
+        memcpy(pbDst, pbSrc, cbHead);
+        pbDst += cbHead;
+        pbSrc += cbHead;
+        cb    -= cbHead;
+    }
+
+    /* Stream a cache line at a time. */
+    while (cb >= 64)
+    {
+        uint64_t au64[8];
+        unsigned i;
+        memcpy(au64, pbSrc, sizeof(au64));
+        INTNETSG_PREFETCH(pbSrc + 256);
+        for (i = 0; i < RT_ELEMENTS(au64); i++)
+            __asm__ __volatile__("movnti %1, %0"
+                                 : "=m" (((uint64_t *)pbDst)[i])
+                                 : "r" (au64[i]));
+        pbDst += 64;
+        pbSrc += 64;
+        cb    -= 64;
+    }
+    while (cb >= 8)
+    {
+        uint64_t u64;
+        memcpy(&u64, pbSrc, sizeof(u64));
+        __asm__ __volatile__("movnti %1, %0"
+                             : "=m" (*(uint64_t *)pbDst)
+                             : "r" (u64));
+        pbDst += 8;
+        pbSrc += 8;
+        cb    -= 8;
+    }
+    if (cb)
+        memcpy(pbDst, pbSrc, cb);
+}
+#endif /* INTNETSG_WITH_NT_COPY */
+
+
+/**
+ * Reads an entire SG into a fittingly size buffer, bypassing the cache for
+ * large frames.
+ *
+ * Use this instead of IntNetSgRead when the CPU is done with the buffer once
+ * it has been filled, like when it is handed to a NIC for DMA.  Frames below
+ * INTNETSG_NT_COPY_THRESHOLD are copied by IntNetSgRead.
+ *
+ * @param   pSG         The SG list to read.
+ * @param   pvBuf       The buffer to read into (at least pSG->cbTotal in size).
+ */
+DECLINLINE(void) IntNetSgReadNt(PCINTNETSG pSG, void *pvBuf)
+{
+#ifdef INTNETSG_WITH_NT_COPY
+    if (pSG->cbTotal >= INTNETSG_NT_COPY_THRESHOLD)
+    {
+        uint8_t        *pbDst = (uint8_t *)pvBuf;
+        unsigned        iSeg  = 0;
+        unsigned const  cSegs = pSG->cSegsUsed;
+        do
+        {
+            uint32_t    cbSeg = pSG->aSegs[iSeg].cb;
+            Assert((uintptr_t)pbDst - (uintptr_t)pvBuf + cbSeg <= pSG->cbTotal);
+            if (iSeg + 1 < cSegs)
+                INTNETSG_PREFETCH(pSG->aSegs[iSeg + 1].pv);
+            intnetSgCopyNt(pbDst, (uint8_t const *)pSG->aSegs[iSeg].pv, cbSeg);
+            pbDst += cbSeg;
+        } while (++iSeg < cSegs);
+
+        /* The non-temporal stores are weakly ordered. */
+        __asm__ __volatile__("sfence" : : : "memory");
+        return;
+    }
+#endif
+    IntNetSgRead(pSG, pvBuf);
+}
+
+
+/**
+ * Copies a chunk of memory and adds it to a 16-bit one's complement sum.
+ *
+ * @returns The updated intermediate checksum, see RTNetIPv4AddDataChecksum.
+ * @param   pbDst       The destination.
+ * @param   pbSrc       The source.
+ * @param   cb          The number of bytes to copy.
+ * @param   u32Sum      The intermediate checksum so far.
+ * @param   pfOdd       Odd byte tracking, see RTNetIPv4AddDataChecksum.
+ */
+DECLINLINE(uint32_t) intnetSgCopyAndSum(uint8_t *pbDst, uint8_t const *pbSrc, uint32_t cb, uint32_t u32Sum, bool *pfOdd)
+{
+    uint64_t u64Sum = u32Sum;
+
+    if (*pfOdd && cb)
+    {
+        /* The previous chunk ended with an odd byte, this is its other half. */
+#ifdef RT_BIG_ENDIAN
+        u64Sum += *pbSrc;
+#else
+        u64Sum += (uint32_t)*pbSrc << 8;
+#endif
+        *pbDst++ = *pbSrc++;
+        cb--;
+        *pfOdd = false;
+    }
+
+    /* Summing 32-bit words and folding at the end gives the same 16-bit
+       one's complement sum as summing 16-bit words, in half the adds. */
+    while (cb >= 16)
+    {
+        uint32_t au32[4];
+        memcpy(au32, pbSrc, sizeof(au32));
+        memcpy(pbDst, au32, sizeof(au32));
+        u64Sum += (uint64_t)au32[0] + au32[1] + au32[2] + au32[3];
+        pbDst += 16;
+        pbSrc += 16;
+        cb    -= 16;
+    }
+    while (cb >= 4)
+    {
+        uint32_t u32;
+        memcpy(&u32, pbSrc, sizeof(u32));
+        memcpy(pbDst, &u32, sizeof(u32));
+        u64Sum += u32;
+        pbDst += 4;
+        pbSrc += 4;
+        cb    -= 4;
+    }
+    if (cb >= 2)
+    {
+        uint16_t u16;
+        memcpy(&u16, pbSrc, sizeof(u16));
+        memcpy(pbDst, &u16, sizeof(u16));
+        u64Sum += u16;
+        pbDst += 2;
+        pbSrc += 2;
+        cb    -= 2;
+    }
+    if (cb)
+    {
+#ifdef RT_BIG_ENDIAN
+        u64Sum += (uint32_t)*pbSrc << 8;
+#else
+        u64Sum += *pbSrc;
+#endif
+        *pbDst = *pbSrc;
+        *pfOdd = true;
+    }
+
+    /* Fold back into 32 bits with end around carry, which preserves the
+       sum modulo 0xffff. */
+    u64Sum = (u64Sum & UINT32_MAX) + (u64Sum >> 32);
+    u64Sum = (u64Sum & UINT32_MAX) + (u64Sum >> 32);
+    return (uint32_t)u64Sum;
+}
+
+
+/**
+ * Reads a portion of an SG into a buffer and calculates the Internet checksum
+ * of what it copied in the same pass.
+ *
+ * This saves a second trip over the data when the checksum is needed anyway,
+ * e.g. for verifying the transport checksum of a frame delivered to the host.
+ *
+ * @returns The updated intermediate checksum.  Pass it on to
+ *          RTNetIPv4FinalizeChecksum or use it as a partial checksum.
+ * @param   pSG         The SG list to read.
+ * @param   offSrc      The offset to start copying (and summing) from.
+ * @param   cbToRead    The number of bytes to copy.
+ * @param   pvBuf       The buffer to read into, cb or more in size.
+ * @param   u32Sum      The intermediate checksum to add to, 0 if starting.
+ * @param   pfOdd       Odd byte tracking, initialize to false when starting.
+ *                      See RTNetIPv4AddDataChecksum.
+ */
+DECLINLINE(uint32_t) IntNetSgReadExAndChecksum(PCINTNETSG pSG, uint32_t offSrc, uint32_t cbToRead, void *pvBuf,
+                                               uint32_t u32Sum, bool *pfOdd)
+{
+    uint8_t    *pbDst = (uint8_t *)pvBuf;
+    uint32_t    iSeg  = 0;
+
+    /* validate assumptions */
+    Assert(cbToRead          <= pSG->cbTotal);
+    Assert(offSrc            <= pSG->cbTotal);
+    Assert(offSrc + cbToRead <= pSG->cbTotal);
+
+    /* Skip to the segment containing offSrc. */
+    while (offSrc && offSrc >= pSG->aSegs[iSeg].cb)
+    {
+        offSrc -= pSG->aSegs[iSeg].cb;
+        iSeg++;
+    }
+
+    while (cbToRead)
+    {
+        uint32_t cbChunk = RT_MIN(pSG->aSegs[iSeg].cb - offSrc, cbToRead);
+        Assert(iSeg < pSG->cSegsUsed);
+        if (iSeg + 1 < pSG->cSegsUsed)
+            INTNETSG_PREFETCH(pSG->aSegs[iSeg + 1].pv);
+        u32Sum = intnetSgCopyAndSum(pbDst, (uint8_t const *)pSG->aSegs[iSeg].pv + offSrc, cbChunk, u32Sum, pfOdd);
+        pbDst    += cbChunk;
+        cbToRead -= cbChunk;
+        offSrc    = 0;
+        iSeg++;
+    }
+    return u32Sum;
+}
+
 #ifdef __cplusplus
 
+/**
+ * Gets the read offset the writer should use when looking for free space.
+ *
+ * @returns The read offset.  With the split layout this is the writer's copy,
+ *          which may be behind offReadX.
+ * @param   pRingBuf        The ring buffer.
+ */
+DECLINLINE(uint32_t) intnetRingWriterGetReadOff(PINTNETRINGBUF pRingBuf)
+{
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    return pRingBuf->offReadCache;
+#else
+    return ASMAtomicUoReadU32(&pRingBuf->offReadX);
+#endif
+}
+
+
+/**
+ * Refreshes the writer's copy of the read offset after a frame didn't fit.
+ *
+ * @returns true if the read offset moved and it's worth trying again, false
+ *          if the ring really is full.
+ * @param   pRingBuf        The ring buffer.
+ * @param   poffRead        The read offset that was used.  Updated.
+ */
+DECLINLINE(bool) intnetRingWriterRefreshReadOff(PINTNETRINGBUF pRingBuf, uint32_t *poffRead)
+{
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    uint32_t const offRead = ASMAtomicUoReadU32(&pRingBuf->offReadX);
+    pRingBuf->offReadCache = offRead;
+    if (offRead == *poffRead)
+        return false;
+    *poffRead = offRead;
+    return true;
+#else
+    NOREF(pRingBuf); NOREF(poffRead);
+    return false;
+#endif
+}
+
+
+/**
+ * Gets the committed write offset the reader should use.
+ *
+ * With the split layout the reader's copy of offWriteCom is used as long as
+ * there is something to read up to it, the real offset is only read when the
+ * ring looks empty.
+ *
+ * @returns The committed write offset.
+ * @param   pRingBuf        The ring buffer.
+ * @param   offRead         The current read offset.
+ */
+DECLINLINE(uint32_t) intnetRingReaderGetWriteComOff(PINTNETRINGBUF pRingBuf, uint32_t offRead)
+{
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    uint32_t offWriteCom = pRingBuf->offWriteComCache;
+    if (offWriteCom == offRead)
+    {
+        offWriteCom = ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+        pRingBuf->offWriteComCache = offWriteCom;
+    }
+    return offWriteCom;
+#else
+    NOREF(offRead);
+    return ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+#endif
+}
+
+
 /**
  * Get the amount of space available for writing.
  *
+ * This reads the shared offsets and leaves the cached copies alone, so it can
+ * be used by either side.
+ *
  * @returns Number of available bytes.
  * @param   pRingBuf        The ring buffer.
  */
@@ -272,6 +614,9 @@ DECLINLINE(uint32_t) IntNetRingGetWritable(PINTNETRINGBUF pRingBuf)
 /**
  * Checks if the ring has more for us to read.
  *
+ * This reads the shared offsets and leaves the cached copies alone, so it can
+ * be used by either side.
+ *
  * @returns Number of ready bytes.
  * @param   pRingBuf        The ring buffer.
  */
@@ -286,13 +631,15 @@ DECLINLINE(bool) IntNetRingHasMoreToRead(PINTNETRINGBUF pRingBuf)
 /**
  * Gets the next frame to read.
  *
+ * Only for use by the reader.
+ *
  * @returns Pointer to the next frame.  NULL if done.
  * @param   pRingBuf        The ring buffer.
  */
 DECLINLINE(PINTNETHDR) IntNetRingGetNextFrameToRead(PINTNETRINGBUF pRingBuf)
 {
     uint32_t const offRead     = ASMAtomicUoReadU32(&pRingBuf->offReadX);
-    uint32_t const offWriteCom = ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+    uint32_t const offWriteCom = intnetRingReaderGetWriteComOff(pRingBuf, offRead);
     if (offRead == offWriteCom)
         return NULL;
     return (PINTNETHDR)((uint8_t *)pRingBuf + offRead);
@@ -302,6 +649,9 @@ DECLINLINE(PINTNETHDR) IntNetRingGetNextFrameToRead(PINTNETRINGBUF pRingBuf)
 /**
  * Get the amount of data ready for reading.
  *
+ * This reads the shared offsets and leaves the cached copies alone, so it can
+ * be used by either side.
+ *
  * @returns Number of ready bytes.
  * @param   pRingBuf        The ring buffer.
  */
@@ -362,6 +712,25 @@ DECLINLINE(PPDMNETWORKGSO) IntNetHdrGetGsoContext(PCINTNETHDR pHdr, PCINTNETBUF
 }
 
 
+/**
+ * Calculates the read offset following a frame.
+ *
+ * @returns The offset of the next frame header.
+ * @param   pRingBuf    The ring buffer in question.
+ * @param   offRead     The offset of the frame header.
+ * @param   pHdr        The frame header.
+ */
+DECLINLINE(uint32_t) intnetRingCalcNextReadOff(PINTNETRINGBUF pRingBuf, uint32_t offRead, PCINTNETHDR pHdr)
+{
+    uint32_t offReadNew = offRead + pHdr->offFrame + pHdr->cbFrame;
+    offReadNew = RT_ALIGN_32(offReadNew, INTNETHDR_ALIGNMENT);
+    Assert(offReadNew <= pRingBuf->offEnd && offReadNew >= pRingBuf->offStart);
+    if (offReadNew >= pRingBuf->offEnd)
+        offReadNew = pRingBuf->offStart;
+    return offReadNew;
+}
+
+
 /**
  * Skips to the next (read) frame in the buffer.
  *
@@ -391,6 +760,64 @@ DECLINLINE(void) IntNetRingSkipFrame(PINTNETRINGBUF pRingBuf)
 }
 
 
+/**
+ * Gets a batch of frames to read.
+ *
+ * The frames are returned in ring order, padding frames included, and stay
+ * in the ring until they're skipped by IntNetRingSkipFrames.  Only for use by
+ * the reader.
+ *
+ * @returns Number of frames returned in @a papHdrs, 0 if the ring is empty.
+ * @param   pRingBuf    The ring buffer in question.
+ * @param   papHdrs     Where to return the frame headers.
+ * @param   cMaxFrames  The max number of frames to return.
+ */
+DECLINLINE(uint32_t) IntNetRingGetNextFramesToRead(PINTNETRINGBUF pRingBuf, PINTNETHDR *papHdrs, uint32_t cMaxFrames)
+{
+    uint32_t        offRead     = ASMAtomicUoReadU32(&pRingBuf->offReadX);
+    uint32_t const  offWriteCom = intnetRingReaderGetWriteComOff(pRingBuf, offRead);
+    uint32_t        cFrames     = 0;
+    while (offRead != offWriteCom && cFrames < cMaxFrames)
+    {
+        PINTNETHDR pHdr = (PINTNETHDR)((uint8_t *)pRingBuf + offRead);
+        INTNETHDR_ASSERT_SANITY(pHdr, pRingBuf);
+        papHdrs[cFrames++] = pHdr;
+        offRead = intnetRingCalcNextReadOff(pRingBuf, offRead, pHdr);
+    }
+    return cFrames;
+}
+
+
+/**
+ * Skips a number of (read) frames in the buffer with a single update of the
+ * read offset.
+ *
+ * @param   pRingBuf    The ring buffer in question.
+ * @param   cFrames     The number of frames to skip.  This must not exceed
+ *                      what IntNetRingGetNextFramesToRead returned.
+ */
+DECLINLINE(void) IntNetRingSkipFrames(PINTNETRINGBUF pRingBuf, uint32_t cFrames)
+{
+    uint32_t const  offReadOld  = ASMAtomicUoReadU32(&pRingBuf->offReadX);
+    uint32_t        offReadNew  = offReadOld;
+    Assert(cFrames > 0);
+    while (cFrames-- > 0)
+    {
+        PINTNETHDR      pHdr    = (PINTNETHDR)((uint8_t *)pRingBuf + offReadNew);
+        Assert(offReadNew != ASMAtomicUoReadU32(&pRingBuf->offWriteCom));
+        Assert(IntNetIsValidFrameType(pHdr->u16Type));
+        uint32_t const  offNext = intnetRingCalcNextReadOff(pRingBuf, offReadNew, pHdr);
+#ifdef INTNET_POISON_READ_FRAMES
+        memset((uint8_t *)pHdr + pHdr->offFrame, 0xfe, RT_ALIGN_32(pHdr->cbFrame, INTNETHDR_ALIGNMENT));
+        memset(pHdr, 0xef, sizeof(*pHdr));
+#endif
+        offReadNew = offNext;
+    }
+    Log2(("IntNetRingSkipFrames: offReadX: %#x -> %#x\n", offReadOld, offReadNew));
+    ASMAtomicWriteU32(&pRingBuf->offReadX, offReadNew);
+}
+
+
 /**
  * Allocates a frame in the specified ring.
  *
@@ -412,13 +839,15 @@ DECLINLINE(int) intnetRingAllocateFrameInternal(PINTNETRINGBUF pRingBuf, uint32_
 
     const uint32_t  cb          = RT_ALIGN_32(cbFrame, INTNETHDR_ALIGNMENT);
     uint32_t        offWriteInt = ASMAtomicUoReadU32(&pRingBuf->offWriteInt);
-    uint32_t        offRead     = ASMAtomicUoReadU32(&pRingBuf->offReadX);
+    uint32_t        offRead     = intnetRingWriterGetReadOff(pRingBuf);
     if (offRead <= offWriteInt)
     {
         /*
          * Try fit it all before the end of the buffer.
          */
-        if (pRingBuf->offEnd - offWriteInt >= cb + sizeof(INTNETHDR))
+        if (   pRingBuf->offEnd - offWriteInt >  cb + sizeof(INTNETHDR)
+            || (   pRingBuf->offEnd - offWriteInt == cb + sizeof(INTNETHDR)
+                && offRead != pRingBuf->offStart)) /* wrapping onto the reader would make the ring look empty */
         {
             uint32_t offNew = offWriteInt + cb + sizeof(INTNETHDR);
             if (offNew >= pRingBuf->offEnd)
@@ -479,6 +908,8 @@ DECLINLINE(int) intnetRingAllocateFrameInternal(PINTNETRINGBUF pRingBuf, uint32_
     }
 
     /* (it didn't fit) */
+    if (intnetRingWriterRefreshReadOff(pRingBuf, &offRead))
+        return intnetRingAllocateFrameInternal(pRingBuf, cbFrame, u16Type, ppHdr, ppvFrame);
     *ppHdr    = NULL;                   /* shut up gcc, */
     *ppvFrame = NULL;                   /* ditto. */
     STAM_REL_COUNTER_INC(&pRingBuf->cOverflows);
@@ -625,6 +1056,181 @@ DECLINLINE(void) IntNetRingCommitFrameEx(PINTNETRINGBUF pRingBuf, PINTNETHDR pHd
 }
 
 
+/**
+ * Finds room for a frame at the given write offset.
+ *
+ * This is the space calculation of intnetRingAllocateFrameInternal without
+ * any side effects.
+ *
+ * @returns The write offset following the frame, 0 if it doesn't fit.
+ * @param   pRingBuf            The ring buffer.
+ * @param   offWriteInt         The write offset to place the frame header at.
+ * @param   offRead             The read offset.
+ * @param   cb                  The aligned frame size.
+ * @param   poffFrame           Where to return the offset of the frame.
+ */
+DECLINLINE(uint32_t) intnetRingFitFrame(PINTNETRINGBUF pRingBuf, uint32_t offWriteInt, uint32_t offRead, uint32_t cb,
+                                        uint32_t *poffFrame)
+{
+    if (offRead <= offWriteInt)
+    {
+        /* Try fit it all before the end of the buffer.  (Wrapping around
+           onto a reader sitting at the start would make the ring look empty.) */
+        if (pRingBuf->offEnd - offWriteInt >= cb + sizeof(INTNETHDR))
+        {
+            uint32_t offNew = offWriteInt + cb + sizeof(INTNETHDR);
+            if (offNew >= pRingBuf->offEnd)
+            {
+                if (offRead == pRingBuf->offStart)
+                    return 0;
+                offNew = pRingBuf->offStart;
+            }
+            *poffFrame = offWriteInt + sizeof(INTNETHDR);
+            return offNew;
+        }
+        /* Try fit the frame at the start of the buffer. */
+        if (offRead - pRingBuf->offStart > cb) /* not >= ! */
+        {
+            *poffFrame = pRingBuf->offStart;
+            return pRingBuf->offStart + cb;
+        }
+    }
+    /* The reader is ahead of the writer, try fit it into that space. */
+    else if (offRead - offWriteInt > cb + sizeof(INTNETHDR)) /* not >= ! */
+    {
+        *poffFrame = offWriteInt + sizeof(INTNETHDR);
+        return offWriteInt + cb + sizeof(INTNETHDR);
+    }
+    return 0;
+}
+
+
+/**
+ * Allocates a batch of normal frames in the specified ring.
+ *
+ * The space for all the frames is reserved with a single update of the
+ * internal write offset.  If not all frames fit, as many as possible are
+ * allocated.  Commit them all with IntNetRingCommitFrames.
+ *
+ * @returns VINF_SUCCESS (check @a pcAllocated), VERR_BUFFER_OVERFLOW if not
+ *          even the first frame fit, or VERR_WRONG_ORDER on a write race.
+ * @param   pRingBuf            The ring buffer.
+ * @param   cFrames             The number of frames to allocate.
+ * @param   pacbFrames          The frame sizes.
+ * @param   papHdrs             Where to return the frame headers.
+ *                              Don't touch these!
+ * @param   papvFrames          Where to return the frame pointers.
+ * @param   pcAllocated         Where to return the number of frames allocated.
+ */
+DECLINLINE(int) IntNetRingAllocateFrames(PINTNETRINGBUF pRingBuf, uint32_t cFrames, uint32_t const *pacbFrames,
+                                         PINTNETHDR *papHdrs, void **papvFrames, uint32_t *pcAllocated)
+{
+    INTNETRINGBUF_ASSERT_SANITY(pRingBuf);
+    Assert(cFrames > 0);
+
+    /*
+     * Lay out the frames one after the other without touching the ring.
+     */
+    uint32_t const  offWriteIntOld = ASMAtomicUoReadU32(&pRingBuf->offWriteInt);
+    uint32_t        offWriteInt    = offWriteIntOld;
+    uint32_t        offRead        = intnetRingWriterGetReadOff(pRingBuf);
+    uint32_t        i              = 0;
+    while (i < cFrames)
+    {
+        Assert(pacbFrames[i] >= sizeof(RTMAC) * 2);
+        uint32_t offFrame = 0;
+        uint32_t offNew   = intnetRingFitFrame(pRingBuf, offWriteInt, offRead,
+                                               RT_ALIGN_32(pacbFrames[i], INTNETHDR_ALIGNMENT), &offFrame);
+        if (!offNew)
+        {
+            if (intnetRingWriterRefreshReadOff(pRingBuf, &offRead))
+                continue;
+            break;
+        }
+        papHdrs[i]    = (PINTNETHDR)((uint8_t *)pRingBuf + offWriteInt);
+        papvFrames[i] = (uint8_t *)pRingBuf + offFrame;
+        offWriteInt   = offNew;
+        i++;
+    }
+
+    *pcAllocated = 0;
+    if (RT_UNLIKELY(!i))
+    {
+        STAM_REL_COUNTER_INC(&pRingBuf->cOverflows);
+        return VERR_BUFFER_OVERFLOW;
+    }
+
+    /*
+     * Reserve the space and initialize the headers.
+     */
+    if (RT_UNLIKELY(!ASMAtomicCmpXchgU32(&pRingBuf->offWriteInt, offWriteInt, offWriteIntOld)))
+        return VERR_WRONG_ORDER; /* race */
+    Log2(("IntNetRingAllocateFrames: offWriteInt: %#x -> %#x (R=%#x C=%u/%u)\n", offWriteIntOld, offWriteInt, offRead, i, cFrames));
+
+    for (uint32_t j = 0; j < i; j++)
+    {
+        PINTNETHDR pHdr = papHdrs[j];
+        pHdr->u16Type  = INTNETHDR_TYPE_FRAME;
+        pHdr->cbFrame  = (uint16_t)pacbFrames[j]; Assert(pHdr->cbFrame == pacbFrames[j]);
+        pHdr->offFrame = (int32_t)((uintptr_t)papvFrames[j] - (uintptr_t)pHdr);
+    }
+    if (i < cFrames)
+        STAM_REL_COUNTER_INC(&pRingBuf->cOverflows);
+
+    *pcAllocated = i;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Commits a batch of frames with a single update of the committed write
+ * offset.
+ *
+ * The frames must be the ones returned by IntNetRingAllocateFrames (or
+ * consecutive IntNetRingAllocateFrame calls), in allocation order, and must
+ * follow any frames committed previously.
+ *
+ * @param   pRingBuf            The ring buffer.
+ * @param   papHdrs             The frame headers.
+ * @param   cFrames             The number of frames to commit.
+ */
+DECLINLINE(void) IntNetRingCommitFrames(PINTNETRINGBUF pRingBuf, PINTNETHDR const *papHdrs, uint32_t cFrames)
+{
+    /*
+     * Validate input and commit order.
+     */
+    INTNETRINGBUF_ASSERT_SANITY(pRingBuf);
+    Assert(cFrames > 0);
+    Assert(pRingBuf->offWriteCom == ((uintptr_t)papHdrs[0] - (uintptr_t)pRingBuf));
+
+    /*
+     * Walk the frames to sum up the statistics and find the end of the last one.
+     */
+    uint32_t offWriteCom = ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+    uint32_t cbWritten   = 0;
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        PINTNETHDR pHdr = papHdrs[i];
+        INTNETHDR_ASSERT_SANITY(pHdr, pRingBuf);
+        Assert(offWriteCom == ((uintptr_t)pHdr - (uintptr_t)pRingBuf));
+        cbWritten  += pHdr->cbFrame;
+        offWriteCom = (uint32_t)((uintptr_t)pHdr - (uintptr_t)pRingBuf)
+                    + pHdr->offFrame
+                    + RT_ALIGN_32(pHdr->cbFrame, INTNETHDR_ALIGNMENT);
+        if (offWriteCom >= pRingBuf->offEnd)
+        {
+            Assert(offWriteCom == pRingBuf->offEnd);
+            offWriteCom = pRingBuf->offStart;
+        }
+    }
+
+    Log2(("IntNetRingCommitFrames:  offWriteCom: %#x -> %#x (R=%#x C=%u)\n", pRingBuf->offWriteCom, offWriteCom, pRingBuf->offReadX, cFrames));
+    ASMAtomicWriteU32(&pRingBuf->offWriteCom, offWriteCom);
+    STAM_REL_COUNTER_ADD(&pRingBuf->cbStatWritten, cbWritten);
+    STAM_REL_COUNTER_ADD(&pRingBuf->cStatFrames, cFrames);
+}
+
+
 /**
  * Writes a frame to the specified ring.
  *
@@ -648,13 +1254,15 @@ DECLINLINE(int) IntNetRingWriteFrame(PINTNETRINGBUF pRingBuf, const void *pvFram
      */
     const uint32_t  cb          = RT_ALIGN_32(cbFrame, INTNETHDR_ALIGNMENT);
     uint32_t        offWriteInt = ASMAtomicUoReadU32(&pRingBuf->offWriteInt);
-    uint32_t        offRead     = ASMAtomicUoReadU32(&pRingBuf->offReadX);
+    uint32_t        offRead     = intnetRingWriterGetReadOff(pRingBuf);
     if (offRead <= offWriteInt)
     {
         /*
          * Try fit it all before the end of the buffer.
          */
-        if (pRingBuf->offEnd - offWriteInt >= cb + sizeof(INTNETHDR))
+        if (   pRingBuf->offEnd - offWriteInt >  cb + sizeof(INTNETHDR)
+            || (   pRingBuf->offEnd - offWriteInt == cb + sizeof(INTNETHDR)
+                && offRead != pRingBuf->offStart)) /* wrapping onto the reader would make the ring look empty */
         {
             uint32_t offNew = offWriteInt + cb + sizeof(INTNETHDR);
             if (offNew >= pRingBuf->offEnd)
@@ -727,6 +1335,8 @@ DECLINLINE(int) IntNetRingWriteFrame(PINTNETRINGBUF pRingBuf, const void *pvFram
     }
 
     /* (it didn't fit) */
+    if (intnetRingWriterRefreshReadOff(pRingBuf, &offRead))
+        return IntNetRingWriteFrame(pRingBuf, pvFrame, cbFrame);
     STAM_REL_COUNTER_INC(&pRingBuf->cOverflows);
     return VERR_BUFFER_OVERFLOW;
 }
@@ -747,7 +1357,7 @@ DECLINLINE(uint32_t) IntNetRingReadAndSkipFrame(PINTNETRINGBUF pRingBuf, void *p
     INTNETRINGBUF_ASSERT_SANITY(pRingBuf);
 
     uint32_t       offRead     = ASMAtomicUoReadU32(&pRingBuf->offReadX);
-    uint32_t const offWriteCom = ASMAtomicUoReadU32(&pRingBuf->offWriteCom);
+    uint32_t const offWriteCom = intnetRingReaderGetWriteComOff(pRingBuf, offRead);
     if (offRead == offWriteCom)
         return 0;
 
@@ -805,6 +1415,10 @@ DECLINLINE(void) IntNetBufInit(PINTNETBUF pIntBuf, uint32_t cbBuf, uint32_t cbRe
     pIntBuf->Recv.offWriteInt   = offBuf;
     pIntBuf->Recv.offWriteCom   = offBuf;
     pIntBuf->Recv.offEnd        = offBuf + cbRecv;
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    pIntBuf->Recv.offReadCache      = offBuf;
+    pIntBuf->Recv.offWriteComCache  = offBuf;
+#endif
 
     /* send ring buffer. */
     offBuf += cbRecv + RT_OFFSETOF(INTNETBUF, Recv) - RT_OFFSETOF(INTNETBUF, Send);
@@ -813,6 +1427,10 @@ DECLINLINE(void) IntNetBufInit(PINTNETBUF pIntBuf, uint32_t cbBuf, uint32_t cbRe
     pIntBuf->Send.offWriteCom   = offBuf;
     pIntBuf->Send.offWriteInt   = offBuf;
     pIntBuf->Send.offEnd        = offBuf + cbSend;
+#ifdef INTNET_RING_SPLIT_LAYOUT
+    pIntBuf->Send.offReadCache      = offBuf;
+    pIntBuf->Send.offWriteComCache  = offBuf;
+#endif
     Assert(cbBuf >= offBuf + cbSend);
 }
 
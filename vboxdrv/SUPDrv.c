@@ -95,8 +95,15 @@
 *******************************************************************************/
 static DECLCALLBACK(int)    supdrvSessionObjHandleRetain(RTHANDLETABLE hHandleTable, void *pvObj, void *pvCtx, void *pvUser);
 static DECLCALLBACK(void)   supdrvSessionObjHandleDelete(RTHANDLETABLE hHandleTable, uint32_t h, void *pvObj, void *pvCtx, void *pvUser);
+static int                  supdrvObjShardsInit(PSUPDRVDEVEXT pDevExt);
+static void                 supdrvObjShardsTerm(PSUPDRVDEVEXT pDevExt);
+static PSUPDRVUSAGE         supdrvUsageAllocLocked(PSUPDRVDEVEXT pDevExt, PSUPDRVOBJSHARD pShard);
+static void                 supdrvUsageFreeLocked(PSUPDRVDEVEXT pDevExt, PSUPDRVOBJSHARD pShard, PSUPDRVUSAGE pUsage);
+static void                 supdrvObjUnlinkLocked(PSUPDRVOBJSHARD pShard, PSUPDRVOBJ pObj);
 static int                  supdrvMemAdd(PSUPDRVMEMREF pMem, PSUPDRVSESSION pSession);
 static int                  supdrvMemRelease(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, SUPDRVMEMREFTYPE eType);
+static PSUPDRVMEMREF        supdrvMemLookupR0Locked(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, SUPDRVMEMREFTYPE eType);
+static PSUPDRVMEMREF        supdrvMemLookupR3Locked(PSUPDRVSESSION pSession, RTR3PTR pvR3, SUPDRVMEMREFTYPE eType);
 static int                  supdrvIOCtl_LdrOpen(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPLDROPEN pReq);
 static int                  supdrvIOCtl_LdrLoad(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPLDRLOAD pReq);
 static int                  supdrvIOCtl_LdrFree(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPLDRFREE pReq);
@@ -422,7 +429,9 @@ int VBOXCALL supdrvInitDevExt(PSUPDRVDEVEXT pDevExt, size_t cbSession)
 #endif
                 if (RT_SUCCESS(rc))
                 {
-                    rc = supdrvGipCreate(pDevExt);
+                    rc = supdrvObjShardsInit(pDevExt);
+                    if (RT_SUCCESS(rc))
+                        rc = supdrvGipCreate(pDevExt);
                     if (RT_SUCCESS(rc))
                     {
                         pDevExt->u32Cookie = BIRD;  /** @todo make this random? */
@@ -483,6 +492,7 @@ int VBOXCALL supdrvInitDevExt(PSUPDRVDEVEXT pDevExt, size_t cbSession)
                         return VINF_SUCCESS;
                     }
 
+                    supdrvObjShardsTerm(pDevExt);
 #ifdef SUPDRV_USE_MUTEX_FOR_GIP
                     RTSemMutexDestroy(pDevExt->mtxGip);
                     pDevExt->mtxGip = NIL_RTSEMMUTEX;
@@ -521,9 +531,6 @@ int VBOXCALL supdrvInitDevExt(PSUPDRVDEVEXT pDevExt, size_t cbSession)
  */
 void VBOXCALL supdrvDeleteDevExt(PSUPDRVDEVEXT pDevExt)
 {
-    PSUPDRVOBJ          pObj;
-    PSUPDRVUSAGE        pUsage;
-
     /*
      * Kill mutexes and spinlocks.
      */
@@ -547,28 +554,9 @@ void VBOXCALL supdrvDeleteDevExt(PSUPDRVDEVEXT pDevExt)
     pDevExt->mtxComponentFactory = NIL_RTSEMFASTMUTEX;
 
     /*
-     * Free lists.
+     * Free the object lists and usage records.
      */
-    /* objects. */
-    pObj = pDevExt->pObjs;
-    Assert(!pObj);                      /* (can trigger on forced unloads) */
-    pDevExt->pObjs = NULL;
-    while (pObj)
-    {
-        void *pvFree = pObj;
-        pObj = pObj->pNext;
-        RTMemFree(pvFree);
-    }
-
-    /* usage records. */
-    pUsage = pDevExt->pUsageFree;
-    pDevExt->pUsageFree = NULL;
-    while (pUsage)
-    {
-        void *pvFree = pUsage;
-        pUsage = pUsage->pNext;
-        RTMemFree(pvFree);
-    }
+    supdrvObjShardsTerm(pDevExt);
 
     /* kill the GIP. */
     supdrvGipDestroy(pDevExt);
@@ -612,10 +600,11 @@ int VBOXCALL supdrvCreateSession(PSUPDRVDEVEXT pDevExt, bool fUser, PSUPDRVSESSI
                 pSession->u32Cookie         = BIRD_INV;
                 /*pSession->pLdrUsage         = NULL;
                 pSession->pVM               = NULL;
-                pSession->pUsage            = NULL;
+                pSession->apUsageHash[]     = NULL;
                 pSession->pGip              = NULL;
                 pSession->fGipReferenced    = false;
                 pSession->Bundle.cUsed      = 0; */
+                pSession->pBundleFree       = &pSession->Bundle;
                 pSession->Uid               = NIL_RTUID;
                 pSession->Gid               = NIL_RTGID;
                 if (fUser)
@@ -685,6 +674,7 @@ void VBOXCALL supdrvCleanupSession(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSessio
 {
     int                 rc;
     PSUPDRVBUNDLE       pBundle;
+    unsigned            iHash;
     LogFlow(("supdrvCleanupSession: pSession=%p\n", pSession));
 
     /*
@@ -704,56 +694,44 @@ void VBOXCALL supdrvCleanupSession(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSessio
      * In theory there should be noone racing us in this session.
      */
     Log2(("release objects - start\n"));
-    if (pSession->pUsage)
+    for (iHash = 0; iHash < RT_ELEMENTS(pSession->apUsageHash); iHash++)
     {
         RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+        RTSPINLOCKTMP   SessionTmp  = RTSPINLOCKTMP_INITIALIZER;
         PSUPDRVUSAGE    pUsage;
-        RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
 
-        while ((pUsage = pSession->pUsage) != NULL)
+        while ((pUsage = pSession->apUsageHash[iHash]) != NULL)
         {
-            PSUPDRVOBJ  pObj = pUsage->pObj;
-            pSession->pUsage = pUsage->pNext;
+            PSUPDRVOBJ      pObj   = pUsage->pObj;
+            PSUPDRVOBJSHARD pShard = &pDevExt->aObjShards[SUPDRV_OBJ_SHARD(pObj)];
+            RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
+            RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+            pSession->apUsageHash[iHash] = pUsage->pNext;
+            RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
 
             AssertMsg(pUsage->cUsage >= 1 && pObj->cUsage >= pUsage->cUsage, ("glob %d; sess %d\n", pObj->cUsage, pUsage->cUsage));
-            if (pUsage->cUsage < pObj->cUsage)
-            {
-                pObj->cUsage -= pUsage->cUsage;
-                RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
-            }
+            if (ASMAtomicSubU32(&pObj->cUsage, pUsage->cUsage) != pUsage->cUsage)
+                pObj = NULL;
             else
             {
-                /* Destroy the object and free the record. */
-                if (pDevExt->pObjs == pObj)
-                    pDevExt->pObjs = pObj->pNext;
-                else
-                {
-                    PSUPDRVOBJ pObjPrev;
-                    for (pObjPrev = pDevExt->pObjs; pObjPrev; pObjPrev = pObjPrev->pNext)
-                        if (pObjPrev->pNext == pObj)
-                        {
-                            pObjPrev->pNext = pObj->pNext;
-                            break;
-                        }
-                    Assert(pObjPrev);
-                }
-                RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+                /* Unlink the object, it's destroyed below. */
+                pObj->u32Magic = SUPDRVOBJ_MAGIC_DEAD;
+                supdrvObjUnlinkLocked(pShard, pObj);
+            }
 
+            /* free the record and continue. */
+            supdrvUsageFreeLocked(pDevExt, pShard, pUsage);
+            RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
+
+            if (pObj)
+            {
                 Log(("supdrvCleanupSession: destroying %p/%d (%p/%p) cpid=%RTproc pid=%RTproc dtor=%p\n",
                      pObj, pObj->enmType, pObj->pvUser1, pObj->pvUser2, pObj->CreatorProcess, RTProcSelf(), pObj->pfnDestructor));
                 if (pObj->pfnDestructor)
                     pObj->pfnDestructor(pObj, pObj->pvUser1, pObj->pvUser2);
                 RTMemFree(pObj);
             }
-
-            /* free it and continue. */
-            RTMemFree(pUsage);
-
-            RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
         }
-
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
-        AssertMsg(!pSession->pUsage, ("Some buster reregistered an object during desturction!\n"));
     }
     Log2(("release objects - done\n"));
 
@@ -799,10 +777,20 @@ void VBOXCALL supdrvCleanupSession(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSessio
         pBundle = pBundle->pNext;
 
         pToFree->pNext = NULL;
+        pToFree->pNextFree = NULL;
+        pToFree->bmUsed[0] = pToFree->bmUsed[1] = 0;
         pToFree->cUsed = 0;
         if (pToFree != &pSession->Bundle)
             RTMemFree(pToFree);
     }
+
+    /* Reset the index. */
+    pSession->pBundleFree = &pSession->Bundle;
+    pSession->cMemRefs = 0;
+    pSession->cMemHashShift = 0;
+    pSession->papMemHashR3 = NULL;
+    RTMemFree(pSession->papMemHashR0);
+    pSession->papMemHashR0 = NULL;
     Log2(("freeing memory - done\n"));
 
     /*
@@ -954,6 +942,65 @@ int VBOXCALL supdrvIOCtlFast(uintptr_t uIOCtl, VMCPUID idCpu, PSUPDRVDEVEXT pDev
 }
 
 
+/**
+ * Fast path I/O Control worker for SUP_IOCTL_FAST_DO_BATCH.
+ *
+ * The OS specific code copies the batch in before calling us and the entry
+ * statuses back out afterwards.
+ *
+ * @returns VBox status code that should be passed down to ring-3 unchanged.
+ * @param   pDevExt     Device extention.
+ * @param   pSession    Session data.
+ * @param   pBatch      The batch (kernel copy).
+ */
+int VBOXCALL supdrvIOCtlFastBatch(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPFASTBATCH pBatch)
+{
+    PVM         pVM = pSession->pVM;
+    uint32_t    i;
+
+    if (RT_UNLIKELY(!pVM || !pDevExt->pfnVMMR0EntryFast))
+        return VERR_INTERNAL_ERROR;
+    if (RT_UNLIKELY(    pBatch->cEntries > RT_ELEMENTS(pBatch->aEntries)
+                    ||  pBatch->u32Reserved))
+        return VERR_INVALID_PARAMETER;
+
+    /*
+     * Validate the whole batch first.  A run returns to ring-3 because the
+     * exit needs servicing there, so nothing may follow it, and all entries
+     * must be for the VMCPU of the calling EMT.
+     */
+    for (i = 0; i < pBatch->cEntries; i++)
+    {
+        PSUPFASTBATCHENTRY pEntry = &pBatch->aEntries[i];
+        if (RT_UNLIKELY(pEntry->idCpu != pBatch->aEntries[0].idCpu))
+            return VERR_INVALID_PARAMETER;
+        switch (pEntry->uOperation)
+        {
+            case SUP_VMMR0_DO_NOP:
+                break;
+            case SUP_VMMR0_DO_RAW_RUN:
+            case SUP_VMMR0_DO_HWACC_RUN:
+                if (RT_UNLIKELY(i + 1 != pBatch->cEntries))
+                    return VERR_INVALID_PARAMETER;
+                break;
+            default:
+                return VERR_INVALID_PARAMETER;
+        }
+    }
+
+    /*
+     * Run it.
+     */
+    for (i = 0; i < pBatch->cEntries; i++)
+    {
+        PSUPFASTBATCHENTRY pEntry = &pBatch->aEntries[i];
+        pDevExt->pfnVMMR0EntryFast(pVM, pEntry->idCpu, pEntry->uOperation);
+        pEntry->rc = VINF_SUCCESS;
+    }
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Helper for supdrvIOCtl. Check if pszStr contains any character of pszChars.
  * We would use strpbrk here if this function would be contained in the RedHat kABI white
@@ -1799,6 +1846,219 @@ int VBOXCALL supdrvIDC(uintptr_t uReq, PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSe
 }
 
 
+/**
+ * Creates the object list shard spinlocks and the central usage record pool
+ * spinlock.
+ *
+ * @returns IPRT status code.
+ * @param   pDevExt     The device extension.
+ */
+static int supdrvObjShardsInit(PSUPDRVDEVEXT pDevExt)
+{
+    unsigned    i;
+    int         rc = RTSpinlockCreate(&pDevExt->UsageFreeSpinlock);
+    for (i = 0; i < RT_ELEMENTS(pDevExt->aObjShards) && RT_SUCCESS(rc); i++)
+        rc = RTSpinlockCreate(&pDevExt->aObjShards[i].s.Spinlock);
+    return rc;
+}
+
+
+/**
+ * Destroys the object list shard spinlocks and frees any objects and usage
+ * records left in the shards and the central pool.
+ *
+ * This is also used to clean up after a partially failed supdrvObjShardsInit.
+ *
+ * @param   pDevExt     The device extension.
+ */
+static void supdrvObjShardsTerm(PSUPDRVDEVEXT pDevExt)
+{
+    PSUPDRVUSAGE    pUsage;
+    unsigned        i;
+
+    for (i = 0; i < RT_ELEMENTS(pDevExt->aObjShards); i++)
+    {
+        PSUPDRVOBJSHARD pShard = &pDevExt->aObjShards[i];
+        PSUPDRVOBJ      pObj;
+
+        if (pShard->s.Spinlock != NIL_RTSPINLOCK)
+        {
+            RTSpinlockDestroy(pShard->s.Spinlock);
+            pShard->s.Spinlock = NIL_RTSPINLOCK;
+        }
+
+        /* objects. */
+        pObj = pShard->s.pObjs;
+        Assert(!pObj);                  /* (can trigger on forced unloads) */
+        pShard->s.pObjs = NULL;
+        while (pObj)
+        {
+            void *pvFree = pObj;
+            pObj = pObj->pNext;
+            RTMemFree(pvFree);
+        }
+
+        /* cached usage records. */
+        pUsage = pShard->s.pUsageFree;
+        pShard->s.pUsageFree = NULL;
+        pShard->s.cUsageFree = 0;
+        while (pUsage)
+        {
+            void *pvFree = pUsage;
+            pUsage = pUsage->pNext;
+            RTMemFree(pvFree);
+        }
+    }
+
+    /* the central usage record pool. */
+    if (pDevExt->UsageFreeSpinlock != NIL_RTSPINLOCK)
+    {
+        RTSpinlockDestroy(pDevExt->UsageFreeSpinlock);
+        pDevExt->UsageFreeSpinlock = NIL_RTSPINLOCK;
+    }
+    pUsage = pDevExt->pUsageFree;
+    pDevExt->pUsageFree = NULL;
+    pDevExt->cUsageFree = 0;
+    while (pUsage)
+    {
+        void *pvFree = pUsage;
+        pUsage = pUsage->pNext;
+        RTMemFree(pvFree);
+    }
+}
+
+
+/**
+ * Gets a free usage record from the cache of an object list shard.
+ *
+ * When the cache is empty it's refilled with up to SUPDRV_USAGE_BATCH
+ * records from the central pool.
+ *
+ * The caller must own the shard spinlock.
+ *
+ * @returns Pointer to the usage record, NULL if both the cache and the
+ *          central pool are empty.
+ * @param   pDevExt     The device extension.
+ * @param   pShard      The object list shard.
+ */
+static PSUPDRVUSAGE supdrvUsageAllocLocked(PSUPDRVDEVEXT pDevExt, PSUPDRVOBJSHARD pShard)
+{
+    PSUPDRVUSAGE pUsage = pShard->s.pUsageFree;
+    if (RT_UNLIKELY(!pUsage))
+    {
+        RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+        PSUPDRVUSAGE    pLast;
+        uint32_t        cMoved = 0;
+
+        RTSpinlockAcquire(pDevExt->UsageFreeSpinlock, &SpinlockTmp);
+        pUsage = pLast = pDevExt->pUsageFree;
+        if (pUsage)
+        {
+            cMoved = 1;
+            while (cMoved < SUPDRV_USAGE_BATCH && pLast->pNext)
+            {
+                pLast = pLast->pNext;
+                cMoved++;
+            }
+            pDevExt->pUsageFree = pLast->pNext;
+            pDevExt->cUsageFree -= cMoved;
+            pLast->pNext = NULL;
+        }
+        RTSpinlockRelease(pDevExt->UsageFreeSpinlock, &SpinlockTmp);
+
+        if (!pUsage)
+            return NULL;
+        pShard->s.cUsageFree = cMoved;
+    }
+
+    pShard->s.pUsageFree = pUsage->pNext;
+    pShard->s.cUsageFree--;
+    return pUsage;
+}
+
+
+/**
+ * Puts a usage record into the cache of an object list shard.
+ *
+ * When the cache grows beyond twice SUPDRV_USAGE_BATCH, a batch of records
+ * is handed back to the central pool.
+ *
+ * The caller must own the shard spinlock.
+ *
+ * @param   pDevExt     The device extension.
+ * @param   pShard      The object list shard.
+ * @param   pUsage      The usage record to free.
+ */
+static void supdrvUsageFreeLocked(PSUPDRVDEVEXT pDevExt, PSUPDRVOBJSHARD pShard, PSUPDRVUSAGE pUsage)
+{
+    pUsage->pNext = pShard->s.pUsageFree;
+    pShard->s.pUsageFree = pUsage;
+    if (RT_UNLIKELY(++pShard->s.cUsageFree > SUPDRV_USAGE_BATCH * 2))
+    {
+        RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+        PSUPDRVUSAGE    pFirst      = pShard->s.pUsageFree;
+        PSUPDRVUSAGE    pLast       = pFirst;
+        unsigned        i;
+
+        for (i = 1; i < SUPDRV_USAGE_BATCH; i++)
+            pLast = pLast->pNext;
+        pShard->s.pUsageFree = pLast->pNext;
+        pShard->s.cUsageFree -= SUPDRV_USAGE_BATCH;
+
+        RTSpinlockAcquire(pDevExt->UsageFreeSpinlock, &SpinlockTmp);
+        pLast->pNext = pDevExt->pUsageFree;
+        pDevExt->pUsageFree = pFirst;
+        pDevExt->cUsageFree += SUPDRV_USAGE_BATCH;
+        RTSpinlockRelease(pDevExt->UsageFreeSpinlock, &SpinlockTmp);
+    }
+}
+
+
+/**
+ * Unlinks an object from its shard.
+ *
+ * The caller must own the shard spinlock.
+ *
+ * @param   pShard      The object list shard.
+ * @param   pObj        The object.
+ */
+static void supdrvObjUnlinkLocked(PSUPDRVOBJSHARD pShard, PSUPDRVOBJ pObj)
+{
+    if (pShard->s.pObjs == pObj)
+        pShard->s.pObjs = pObj->pNext;
+    else
+    {
+        PSUPDRVOBJ pObjPrev;
+        for (pObjPrev = pShard->s.pObjs; pObjPrev; pObjPrev = pObjPrev->pNext)
+            if (pObjPrev->pNext == pObj)
+            {
+                pObjPrev->pNext = pObj->pNext;
+                break;
+            }
+        Assert(pObjPrev);
+    }
+}
+
+
+/**
+ * Finds the usage record link for an object in a session.
+ *
+ * The caller must own the session spinlock.
+ *
+ * @returns Pointer to the link pointing to the usage record, or to the NULL
+ *          terminating the hash chain if the session doesn't use the object.
+ * @param   pSession    The session.
+ * @param   pObj        The object.
+ */
+DECLINLINE(PSUPDRVUSAGE *) supdrvUsageFindLocked(PSUPDRVSESSION pSession, PSUPDRVOBJ pObj)
+{
+    PSUPDRVUSAGE *ppUsage = &pSession->apUsageHash[SUPDRV_USAGE_HASH(pObj)];
+    while (*ppUsage && (*ppUsage)->pObj != pObj)
+        ppUsage = (PSUPDRVUSAGE *)&(*ppUsage)->pNext;
+    return ppUsage;
+}
+
+
 /**
  * Register a object for reference counting.
  * The object is registered with one reference in the specified session.
@@ -1813,9 +2073,12 @@ int VBOXCALL supdrvIDC(uintptr_t uReq, PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSe
 SUPR0DECL(void *) SUPR0ObjRegister(PSUPDRVSESSION pSession, SUPDRVOBJTYPE enmType, PFNSUPDRVDESTRUCTOR pfnDestructor, void *pvUser1, void *pvUser2)
 {
     RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    RTSPINLOCKTMP   SessionTmp  = RTSPINLOCKTMP_INITIALIZER;
     PSUPDRVDEVEXT   pDevExt     = pSession->pDevExt;
+    PSUPDRVOBJSHARD pShard;
     PSUPDRVOBJ      pObj;
     PSUPDRVUSAGE    pUsage;
+    PSUPDRVUSAGE   *ppUsage;
 
     /*
      * Validate the input.
@@ -1846,38 +2109,40 @@ SUPR0DECL(void *) SUPR0ObjRegister(PSUPDRVSESSION pSession, SUPDRVOBJTYPE enmTyp
      * Allocate the usage record.
      * (We keep freed usage records around to simplify SUPR0ObjAddRefEx().)
      */
-    RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+    pShard = &pDevExt->aObjShards[SUPDRV_OBJ_SHARD(pObj)];
+    RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
 
-    pUsage = pDevExt->pUsageFree;
-    if (pUsage)
-        pDevExt->pUsageFree = pUsage->pNext;
-    else
+    pUsage = supdrvUsageAllocLocked(pDevExt, pShard);
+    if (!pUsage)
     {
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+        RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
         pUsage = (PSUPDRVUSAGE)RTMemAlloc(sizeof(*pUsage));
         if (!pUsage)
         {
             RTMemFree(pObj);
             return NULL;
         }
-        RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+        RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
     }
 
     /*
      * Insert the object and create the session usage record.
      */
     /* The object. */
-    pObj->pNext         = pDevExt->pObjs;
-    pDevExt->pObjs      = pObj;
+    pObj->pNext         = pShard->s.pObjs;
+    pShard->s.pObjs     = pObj;
 
     /* The session record. */
     pUsage->cUsage      = 1;
     pUsage->pObj        = pObj;
-    pUsage->pNext       = pSession->pUsage;
+    RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+    ppUsage             = &pSession->apUsageHash[SUPDRV_USAGE_HASH(pObj)];
+    pUsage->pNext       = *ppUsage;
     /* Log2(("SUPR0ObjRegister: pUsage=%p:{.pObj=%p, .pNext=%p}\n", pUsage, pUsage->pObj, pUsage->pNext)); */
-    pSession->pUsage    = pUsage;
+    *ppUsage            = pUsage;
+    RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
 
-    RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+    RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
 
     Log(("SUPR0ObjRegister: returns %p (pvUser1=%p, pvUser=%p)\n", pObj, pvUser1, pvUser2));
     return pObj;
@@ -1924,10 +2189,13 @@ SUPR0DECL(int) SUPR0ObjAddRef(void *pvObj, PSUPDRVSESSION pSession)
 SUPR0DECL(int) SUPR0ObjAddRefEx(void *pvObj, PSUPDRVSESSION pSession, bool fNoBlocking)
 {
     RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    RTSPINLOCKTMP   SessionTmp  = RTSPINLOCKTMP_INITIALIZER;
     PSUPDRVDEVEXT   pDevExt     = pSession->pDevExt;
     PSUPDRVOBJ      pObj        = (PSUPDRVOBJ)pvObj;
+    PSUPDRVOBJSHARD pShard;
     int             rc          = VINF_SUCCESS;
     PSUPDRVUSAGE    pUsagePre;
+    PSUPDRVUSAGE   *ppUsage;
     PSUPDRVUSAGE    pUsage;
 
     /*
@@ -1941,11 +2209,30 @@ SUPR0DECL(int) SUPR0ObjAddRefEx(void *pvObj, PSUPDRVSESSION pSession, bool fNoBl
                     ("Invalid pvObj=%p magic=%#x (expected %#x or %#x)\n", pvObj, pObj->u32Magic, SUPDRVOBJ_MAGIC, SUPDRVOBJ_MAGIC_DEAD),
                     VERR_INVALID_PARAMETER);
 
-    RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+    /*
+     * If the session already references the object, the object cannot be
+     * destroyed under our feet and we only need the session lock.
+     */
+    RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+    pUsage = *supdrvUsageFindLocked(pSession, pObj);
+    if (RT_LIKELY(pUsage))
+    {
+        pUsage->cUsage++;
+        ASMAtomicIncU32(&pObj->cUsage);
+        RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
+        return VINF_SUCCESS;
+    }
+    RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
+
+    /*
+     * First reference in this session, serialize with object destruction.
+     */
+    pShard = &pDevExt->aObjShards[SUPDRV_OBJ_SHARD(pObj)];
+    RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
 
     if (RT_UNLIKELY(pObj->u32Magic != SUPDRVOBJ_MAGIC))
     {
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+        RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
 
         AssertMsgFailed(("pvObj=%p magic=%#x\n", pvObj, pObj->u32Magic));
         return VERR_WRONG_ORDER;
@@ -1954,20 +2241,18 @@ SUPR0DECL(int) SUPR0ObjAddRefEx(void *pvObj, PSUPDRVSESSION pSession, bool fNoBl
     /*
      * Preallocate the usage record if we can.
      */
-    pUsagePre = pDevExt->pUsageFree;
-    if (pUsagePre)
-        pDevExt->pUsageFree = pUsagePre->pNext;
-    else if (!fNoBlocking)
+    pUsagePre = supdrvUsageAllocLocked(pDevExt, pShard);
+    if (!pUsagePre && !fNoBlocking)
     {
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+        RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
         pUsagePre = (PSUPDRVUSAGE)RTMemAlloc(sizeof(*pUsagePre));
         if (!pUsagePre)
             return VERR_NO_MEMORY;
 
-        RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+        RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
         if (RT_UNLIKELY(pObj->u32Magic != SUPDRVOBJ_MAGIC))
         {
-            RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+            RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
 
             AssertMsgFailed(("pvObj=%p magic=%#x\n", pvObj, pObj->u32Magic));
             return VERR_WRONG_ORDER;
@@ -1975,48 +2260,40 @@ SUPR0DECL(int) SUPR0ObjAddRefEx(void *pvObj, PSUPDRVSESSION pSession, bool fNoBl
     }
 
     /*
-     * Reference the object.
-     */
-    pObj->cUsage++;
-
-    /*
-     * Look for the session record.
+     * Look for the session record again (we may have raced another thread
+     * in this session) and reference the object.
      */
-    for (pUsage = pSession->pUsage; pUsage; pUsage = pUsage->pNext)
-    {
-        /*Log(("SUPR0AddRef: pUsage=%p:{.pObj=%p, .pNext=%p}\n", pUsage, pUsage->pObj, pUsage->pNext));*/
-        if (pUsage->pObj == pObj)
-            break;
-    }
+    RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+    ppUsage = supdrvUsageFindLocked(pSession, pObj);
+    pUsage = *ppUsage;
     if (pUsage)
+    {
         pUsage->cUsage++;
+        ASMAtomicIncU32(&pObj->cUsage);
+    }
     else if (pUsagePre)
     {
         /* create a new session record. */
         pUsagePre->cUsage   = 1;
         pUsagePre->pObj     = pObj;
-        pUsagePre->pNext    = pSession->pUsage;
-        pSession->pUsage    = pUsagePre;
+        pUsagePre->pNext    = NULL;
+        *ppUsage            = pUsagePre;
         /*Log(("SUPR0AddRef: pUsagePre=%p:{.pObj=%p, .pNext=%p}\n", pUsagePre, pUsagePre->pObj, pUsagePre->pNext));*/
+        ASMAtomicIncU32(&pObj->cUsage);
 
         pUsagePre = NULL;
     }
     else
-    {
-        pObj->cUsage--;
         rc = VERR_TRY_AGAIN;
-    }
+    RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
 
     /*
      * Put any unused usage record into the free list..
      */
     if (pUsagePre)
-    {
-        pUsagePre->pNext = pDevExt->pUsageFree;
-        pDevExt->pUsageFree = pUsagePre;
-    }
+        supdrvUsageFreeLocked(pDevExt, pShard, pUsagePre);
 
-    RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+    RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
 
     return rc;
 }
@@ -2039,11 +2316,13 @@ SUPR0DECL(int) SUPR0ObjAddRefEx(void *pvObj, PSUPDRVSESSION pSession, bool fNoBl
 SUPR0DECL(int) SUPR0ObjRelease(void *pvObj, PSUPDRVSESSION pSession)
 {
     RTSPINLOCKTMP       SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    RTSPINLOCKTMP       SessionTmp  = RTSPINLOCKTMP_INITIALIZER;
     PSUPDRVDEVEXT       pDevExt     = pSession->pDevExt;
     PSUPDRVOBJ          pObj        = (PSUPDRVOBJ)pvObj;
+    PSUPDRVOBJSHARD     pShard;
     int                 rc          = VERR_INVALID_PARAMETER;
+    PSUPDRVUSAGE       *ppUsage;
     PSUPDRVUSAGE        pUsage;
-    PSUPDRVUSAGE        pUsagePrev;
 
     /*
      * Validate the input.
@@ -2054,66 +2333,64 @@ SUPR0DECL(int) SUPR0ObjRelease(void *pvObj, PSUPDRVSESSION pSession)
                     VERR_INVALID_PARAMETER);
 
     /*
-     * Acquire the spinlock and look for the usage record.
+     * If this isn't the last reference the session has to the object, the
+     * object stays alive and we only need the session lock.
      */
-    RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+    RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+    pUsage = *supdrvUsageFindLocked(pSession, pObj);
+    if (RT_LIKELY(pUsage && pUsage->cUsage > 1))
+    {
+        AssertMsg(pObj->cUsage >= pUsage->cUsage, ("glob %d; sess %d\n", pObj->cUsage, pUsage->cUsage));
+        pUsage->cUsage--;
+        ASMAtomicDecU32(&pObj->cUsage);
+        RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
+        return VINF_SUCCESS;
+    }
+    RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
+    AssertMsgReturn(pUsage, ("pvObj=%p\n", pvObj), VERR_INVALID_PARAMETER);
 
-    for (pUsagePrev = NULL, pUsage = pSession->pUsage;
-         pUsage;
-         pUsagePrev = pUsage, pUsage = pUsage->pNext)
+    /*
+     * Dropping the session's last reference may destroy the object, so take
+     * spinlock of the object's shard and look up the usage record again.
+     */
+    pShard = &pDevExt->aObjShards[SUPDRV_OBJ_SHARD(pObj)];
+    RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
+    RTSpinlockAcquire(pSession->Spinlock, &SessionTmp);
+
+    ppUsage = supdrvUsageFindLocked(pSession, pObj);
+    pUsage = *ppUsage;
+    if (pUsage)
     {
-        /*Log2(("SUPR0ObjRelease: pUsage=%p:{.pObj=%p, .pNext=%p}\n", pUsage, pUsage->pObj, pUsage->pNext));*/
-        if (pUsage->pObj == pObj)
+        rc = VINF_SUCCESS;
+        AssertMsg(pUsage->cUsage >= 1 && pObj->cUsage >= pUsage->cUsage, ("glob %d; sess %d\n", pObj->cUsage, pUsage->cUsage));
+        if (pUsage->cUsage > 1)
         {
-            rc = VINF_SUCCESS;
-            AssertMsg(pUsage->cUsage >= 1 && pObj->cUsage >= pUsage->cUsage, ("glob %d; sess %d\n", pObj->cUsage, pUsage->cUsage));
-            if (pUsage->cUsage > 1)
-            {
-                pObj->cUsage--;
-                pUsage->cUsage--;
-            }
-            else
+            pUsage->cUsage--;
+            ASMAtomicDecU32(&pObj->cUsage);
+        }
+        else
+        {
+            /*
+             * Free the session record.
+             */
+            *ppUsage = pUsage->pNext;
+            supdrvUsageFreeLocked(pDevExt, pShard, pUsage);
+
+            /* What about the object? */
+            if (!ASMAtomicDecU32(&pObj->cUsage))
             {
                 /*
-                 * Free the session record.
+                 * Object is to be destroyed, unlink it.
                  */
-                if (pUsagePrev)
-                    pUsagePrev->pNext = pUsage->pNext;
-                else
-                    pSession->pUsage = pUsage->pNext;
-                pUsage->pNext = pDevExt->pUsageFree;
-                pDevExt->pUsageFree = pUsage;
-
-                /* What about the object? */
-                if (pObj->cUsage > 1)
-                    pObj->cUsage--;
-                else
-                {
-                    /*
-                     * Object is to be destroyed, unlink it.
-                     */
-                    pObj->u32Magic = SUPDRVOBJ_MAGIC_DEAD;
-                    rc = VINF_OBJECT_DESTROYED;
-                    if (pDevExt->pObjs == pObj)
-                        pDevExt->pObjs = pObj->pNext;
-                    else
-                    {
-                        PSUPDRVOBJ pObjPrev;
-                        for (pObjPrev = pDevExt->pObjs; pObjPrev; pObjPrev = pObjPrev->pNext)
-                            if (pObjPrev->pNext == pObj)
-                            {
-                                pObjPrev->pNext = pObj->pNext;
-                                break;
-                            }
-                        Assert(pObjPrev);
-                    }
-                }
+                pObj->u32Magic = SUPDRVOBJ_MAGIC_DEAD;
+                rc = VINF_OBJECT_DESTROYED;
+                supdrvObjUnlinkLocked(pShard, pObj);
             }
-            break;
         }
     }
 
-    RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+    RTSpinlockRelease(pSession->Spinlock, &SessionTmp);
+    RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
 
     /*
      * Call the destructor and free the object if required.
@@ -2495,7 +2772,7 @@ SUPR0DECL(int) SUPR0MemAlloc(PSUPDRVSESSION pSession, uint32_t cb, PRTR0PTR ppvR
  */
 SUPR0DECL(int) SUPR0MemGetPhys(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, PSUPPAGE paPages) /** @todo switch this bugger to RTHCPHYS */
 {
-    PSUPDRVBUNDLE pBundle;
+    PSUPDRVMEMREF pEntry;
     RTSPINLOCKTMP SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
     LogFlow(("SUPR0MemGetPhys: pSession=%p uPtr=%p paPages=%p\n", pSession, (void *)uPtr, paPages));
 
@@ -2510,33 +2787,20 @@ SUPR0DECL(int) SUPR0MemGetPhys(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, PSUPPA
      * Search for the address.
      */
     RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
+    pEntry = supdrvMemLookupR0Locked(pSession, uPtr, MEMREF_TYPE_MEM);
+    if (!pEntry)
+        pEntry = supdrvMemLookupR3Locked(pSession, (RTR3PTR)uPtr, MEMREF_TYPE_MEM);
+    if (pEntry)
     {
-        if (pBundle->cUsed > 0)
+        const size_t cPages = RTR0MemObjSize(pEntry->MemObj) >> PAGE_SHIFT;
+        size_t iPage;
+        for (iPage = 0; iPage < cPages; iPage++)
         {
-            unsigned i;
-            for (i = 0; i < RT_ELEMENTS(pBundle->aMem); i++)
-            {
-                if (    pBundle->aMem[i].eType == MEMREF_TYPE_MEM
-                    &&  pBundle->aMem[i].MemObj != NIL_RTR0MEMOBJ
-                    &&  (   (RTHCUINTPTR)RTR0MemObjAddress(pBundle->aMem[i].MemObj) == uPtr
-                         || (   pBundle->aMem[i].MapObjR3 != NIL_RTR0MEMOBJ
-                             && RTR0MemObjAddressR3(pBundle->aMem[i].MapObjR3) == uPtr)
-                        )
-                   )
-                {
-                    const size_t cPages = RTR0MemObjSize(pBundle->aMem[i].MemObj) >> PAGE_SHIFT;
-                    size_t iPage;
-                    for (iPage = 0; iPage < cPages; iPage++)
-                    {
-                        paPages[iPage].Phys = RTR0MemObjGetPagePhysAddr(pBundle->aMem[i].MemObj, iPage);
-                        paPages[iPage].uReserved = 0;
-                    }
-                    RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
-                    return VINF_SUCCESS;
-                }
-            }
+            paPages[iPage].Phys = RTR0MemObjGetPagePhysAddr(pEntry->MemObj, iPage);
+            paPages[iPage].uReserved = 0;
         }
+        RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
+        return VINF_SUCCESS;
     }
     RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
     Log(("Failed to find %p!!!\n", (void *)uPtr));
@@ -2660,7 +2924,7 @@ SUPR0DECL(int) SUPR0PageMapKernel(PSUPDRVSESSION pSession, RTR3PTR pvR3, uint32_
                                   uint32_t fFlags, PRTR0PTR ppvR0)
 {
     int             rc;
-    PSUPDRVBUNDLE   pBundle;
+    PSUPDRVMEMREF   pEntry;
     RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
     RTR0MEMOBJ      hMemObj = NIL_RTR0MEMOBJ;
     LogFlow(("SUPR0PageMapKernel: pSession=%p pvR3=%p offSub=%#x cbSub=%#x\n", pSession, pvR3, offSub, cbSub));
@@ -2679,28 +2943,11 @@ SUPR0DECL(int) SUPR0PageMapKernel(PSUPDRVSESSION pSession, RTR3PTR pvR3, uint32_
      * Find the memory object.
      */
     RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
-    {
-        if (pBundle->cUsed > 0)
-        {
-            unsigned i;
-            for (i = 0; i < RT_ELEMENTS(pBundle->aMem); i++)
-            {
-                if (    (   pBundle->aMem[i].eType == MEMREF_TYPE_PAGE
-                         && pBundle->aMem[i].MemObj != NIL_RTR0MEMOBJ
-                         && pBundle->aMem[i].MapObjR3 != NIL_RTR0MEMOBJ
-                         && RTR0MemObjAddressR3(pBundle->aMem[i].MapObjR3) == pvR3)
-                    ||  (   pBundle->aMem[i].eType == MEMREF_TYPE_LOCKED
-                         && pBundle->aMem[i].MemObj != NIL_RTR0MEMOBJ
-                         && pBundle->aMem[i].MapObjR3 == NIL_RTR0MEMOBJ
-                         && RTR0MemObjAddressR3(pBundle->aMem[i].MemObj) == pvR3))
-                {
-                    hMemObj = pBundle->aMem[i].MemObj;
-                    break;
-                }
-            }
-        }
-    }
+    pEntry = supdrvMemLookupR3Locked(pSession, pvR3, MEMREF_TYPE_PAGE);
+    if (!pEntry)
+        pEntry = supdrvMemLookupR3Locked(pSession, pvR3, MEMREF_TYPE_LOCKED);
+    if (pEntry)
+        hMemObj = pEntry->MemObj;
     RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
 
     rc = VERR_INVALID_PARAMETER;
@@ -2746,7 +2993,7 @@ SUPR0DECL(int) SUPR0PageMapKernel(PSUPDRVSESSION pSession, RTR3PTR pvR3, uint32_
 SUPR0DECL(int) SUPR0PageProtect(PSUPDRVSESSION pSession, RTR3PTR pvR3, RTR0PTR pvR0, uint32_t offSub, uint32_t cbSub, uint32_t fProt)
 {
     int             rc;
-    PSUPDRVBUNDLE   pBundle;
+    PSUPDRVMEMREF   pEntry;
     RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
     RTR0MEMOBJ      hMemObjR0 = NIL_RTR0MEMOBJ;
     RTR0MEMOBJ      hMemObjR3 = NIL_RTR0MEMOBJ;
@@ -2765,30 +3012,22 @@ SUPR0DECL(int) SUPR0PageProtect(PSUPDRVSESSION pSession, RTR3PTR pvR3, RTR0PTR p
      * Find the memory object.
      */
     RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
+    if (pvR3 != NIL_RTR3PTR)
     {
-        if (pBundle->cUsed > 0)
-        {
-            unsigned i;
-            for (i = 0; i < RT_ELEMENTS(pBundle->aMem); i++)
-            {
-                if (   pBundle->aMem[i].eType == MEMREF_TYPE_PAGE
-                    && pBundle->aMem[i].MemObj != NIL_RTR0MEMOBJ
-                    && (   pBundle->aMem[i].MapObjR3 != NIL_RTR0MEMOBJ
-                        || pvR3 == NIL_RTR3PTR)
-                    && (   pvR0 == NIL_RTR0PTR
-                        || RTR0MemObjAddress(pBundle->aMem[i].MemObj) == pvR0)
-                    && (   pvR3 == NIL_RTR3PTR
-                        || RTR0MemObjAddressR3(pBundle->aMem[i].MapObjR3) == pvR3))
-                {
-                    if (pvR0 != NIL_RTR0PTR)
-                        hMemObjR0 = pBundle->aMem[i].MemObj;
-                    if (pvR3 != NIL_RTR3PTR)
-                        hMemObjR3 = pBundle->aMem[i].MapObjR3;
-                    break;
-                }
-            }
-        }
+        pEntry = supdrvMemLookupR3Locked(pSession, pvR3, MEMREF_TYPE_PAGE);
+        if (    pEntry
+            &&  (   pEntry->MapObjR3 == NIL_RTR0MEMOBJ
+                 || (pvR0 != NIL_RTR0PTR && pEntry->uPtrR0 != (RTHCUINTPTR)pvR0)))
+            pEntry = NULL;
+    }
+    else
+        pEntry = supdrvMemLookupR0Locked(pSession, (RTHCUINTPTR)pvR0, MEMREF_TYPE_PAGE);
+    if (pEntry)
+    {
+        if (pvR0 != NIL_RTR0PTR)
+            hMemObjR0 = pEntry->MemObj;
+        if (pvR3 != NIL_RTR3PTR)
+            hMemObjR3 = pEntry->MapObjR3;
     }
     RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
 
@@ -3469,9 +3708,167 @@ SUPR0DECL(int) SUPR0ComponentQueryFactory(PSUPDRVSESSION pSession, const char *p
 }
 
 
+/**
+ * Calculates the memory reference hash table index of an address.
+ *
+ * @returns Hash table index.
+ * @param   uPtr        The ring-0 or ring-3 address.
+ * @param   cShift      The log2 size of the hash table.
+ */
+DECLINLINE(uint32_t) supdrvMemHash(RTHCUINTPTR uPtr, uint32_t cShift)
+{
+    uint64_t u64 = (uint64_t)uPtr >> PAGE_SHIFT;
+    return ((uint32_t)(u64 ^ (u64 >> 32)) * UINT32_C(0x9e3779b1)) >> (32 - cShift);
+}
+
+
+/**
+ * Inserts a memory reference into the address index of the session.
+ *
+ * The caller must own the session spinlock and the hash tables must be
+ * allocated.
+ *
+ * @param   pSession    The session.
+ * @param   pMem        The memory reference (in a bundle).
+ */
+static void supdrvMemHashInsertLocked(PSUPDRVSESSION pSession, PSUPDRVMEMREF pMem)
+{
+    uint32_t i;
+    if (pMem->uPtrR0)
+    {
+        i = supdrvMemHash(pMem->uPtrR0, pSession->cMemHashShift);
+        pMem->pNextHashR0 = pSession->papMemHashR0[i];
+        pSession->papMemHashR0[i] = pMem;
+    }
+    if (pMem->pvR3 != NIL_RTR3PTR)
+    {
+        i = supdrvMemHash((RTHCUINTPTR)pMem->pvR3, pSession->cMemHashShift);
+        pMem->pNextHashR3 = pSession->papMemHashR3[i];
+        pSession->papMemHashR3[i] = pMem;
+    }
+}
+
+
+/**
+ * Removes a memory reference from the address index of the session.
+ *
+ * The caller must own the session spinlock.
+ *
+ * @param   pSession    The session.
+ * @param   pMem        The memory reference (in a bundle).
+ */
+static void supdrvMemHashRemoveLocked(PSUPDRVSESSION pSession, PSUPDRVMEMREF pMem)
+{
+    PSUPDRVMEMREF *ppCur;
+    if (pMem->uPtrR0)
+    {
+        ppCur = &pSession->papMemHashR0[supdrvMemHash(pMem->uPtrR0, pSession->cMemHashShift)];
+        while (*ppCur && *ppCur != pMem)
+            ppCur = &(*ppCur)->pNextHashR0;
+        Assert(*ppCur == pMem);
+        if (*ppCur)
+            *ppCur = pMem->pNextHashR0;
+        pMem->pNextHashR0 = NULL;
+    }
+    if (pMem->pvR3 != NIL_RTR3PTR)
+    {
+        ppCur = &pSession->papMemHashR3[supdrvMemHash((RTHCUINTPTR)pMem->pvR3, pSession->cMemHashShift)];
+        while (*ppCur && *ppCur != pMem)
+            ppCur = &(*ppCur)->pNextHashR3;
+        Assert(*ppCur == pMem);
+        if (*ppCur)
+            *ppCur = pMem->pNextHashR3;
+        pMem->pNextHashR3 = NULL;
+    }
+}
+
+
+/**
+ * Moves all the memory references of a session over to a new (larger) pair
+ * of hash tables.
+ *
+ * The caller must own the session spinlock.
+ *
+ * @returns The old hash table block, to be freed after releasing the spinlock.
+ * @param   pSession    The session.
+ * @param   papHashNew  The new hash table block, zeroed, 2 << cShiftNew entries.
+ * @param   cShiftNew   The log2 size of the new hash tables.
+ */
+static PSUPDRVMEMREF *supdrvMemRehashLocked(PSUPDRVSESSION pSession, PSUPDRVMEMREF *papHashNew, uint32_t cShiftNew)
+{
+    PSUPDRVMEMREF  *papHashOld = pSession->papMemHashR0;
+    PSUPDRVBUNDLE   pBundle;
+
+    pSession->papMemHashR0  = papHashNew;
+    pSession->papMemHashR3  = papHashNew + RT_BIT_32(cShiftNew);
+    pSession->cMemHashShift = cShiftNew;
+
+    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
+    {
+        int iEntry = pBundle->cUsed ? ASMBitFirstSet(&pBundle->bmUsed[0], RT_ELEMENTS(pBundle->aMem)) : -1;
+        while (iEntry >= 0)
+        {
+            supdrvMemHashInsertLocked(pSession, &pBundle->aMem[iEntry]);
+            iEntry = ASMBitNextSet(&pBundle->bmUsed[0], RT_ELEMENTS(pBundle->aMem), iEntry);
+        }
+    }
+    return papHashOld;
+}
+
+
+/**
+ * Looks up a memory reference by its ring-0 address and type.
+ *
+ * The caller must own the session spinlock.
+ *
+ * @returns Pointer to the memory reference, NULL if not found.
+ * @param   pSession    The session.
+ * @param   uPtr        The ring-0 address.
+ * @param   eType       The memory type.
+ */
+static PSUPDRVMEMREF supdrvMemLookupR0Locked(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, SUPDRVMEMREFTYPE eType)
+{
+    PSUPDRVMEMREF pMem = NULL;
+    if (pSession->cMemHashShift && uPtr)
+    {
+        pMem = pSession->papMemHashR0[supdrvMemHash(uPtr, pSession->cMemHashShift)];
+        while (pMem && (pMem->uPtrR0 != uPtr || pMem->eType != eType))
+            pMem = pMem->pNextHashR0;
+    }
+    return pMem;
+}
+
+
+/**
+ * Looks up a memory reference by its ring-3 address and type.
+ *
+ * The caller must own the session spinlock.
+ *
+ * @returns Pointer to the memory reference, NULL if not found.
+ * @param   pSession    The session.
+ * @param   pvR3        The ring-3 address.
+ * @param   eType       The memory type.
+ */
+static PSUPDRVMEMREF supdrvMemLookupR3Locked(PSUPDRVSESSION pSession, RTR3PTR pvR3, SUPDRVMEMREFTYPE eType)
+{
+    PSUPDRVMEMREF pMem = NULL;
+    if (pSession->cMemHashShift && pvR3 != NIL_RTR3PTR)
+    {
+        pMem = pSession->papMemHashR3[supdrvMemHash((RTHCUINTPTR)pvR3, pSession->cMemHashShift)];
+        while (pMem && (pMem->pvR3 != pvR3 || pMem->eType != eType))
+            pMem = pMem->pNextHashR3;
+    }
+    return pMem;
+}
+
+
 /**
  * Adds a memory object to the session.
  *
+ * Free entries are found via the SUPDRVSESSION::pBundleFree list and the
+ * bundle bitmaps, and the entry is indexed by address, so this does not
+ * depend on the number of references the session already has.
+ *
  * @returns IPRT status code.
  * @param   pMem        Memory tracking structure containing the
  *                      information to track.
@@ -3479,51 +3876,116 @@ SUPR0DECL(int) SUPR0ComponentQueryFactory(PSUPDRVSESSION pSession, const char *p
  */
 static int supdrvMemAdd(PSUPDRVMEMREF pMem, PSUPDRVSESSION pSession)
 {
-    PSUPDRVBUNDLE pBundle;
-    RTSPINLOCKTMP SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    PSUPDRVBUNDLE   pBundleNew  = NULL;
+    PSUPDRVMEMREF  *papHashNew  = NULL;
+    PSUPDRVMEMREF  *papHashOld  = NULL;
+    uint32_t        cShiftNew   = 0;
+    bool            fGrowFailed = false;
+    PSUPDRVBUNDLE   pBundle;
+    PSUPDRVMEMREF   pEntry;
+    int             iEntry;
 
     /*
-     * Find free entry and record the allocation.
+     * Resolve the addresses up front so we don't have to call IPRT while
+     * holding the spinlock, neither here nor when looking them up later.
      */
-    RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
+    pMem->uPtrR0      = (RTHCUINTPTR)RTR0MemObjAddress(pMem->MemObj);
+    pMem->pvR3        = RTR0MemObjAddressR3(pMem->MapObjR3 != NIL_RTR0MEMOBJ ? pMem->MapObjR3 : pMem->MemObj);
+    pMem->pBundle     = NULL;
+    pMem->pNextHashR0 = NULL;
+    pMem->pNextHashR3 = NULL;
+
+    /*
+     * Make sure we've got a free entry and a reasonably sized index. The
+     * allocations have to be done outside the spinlock.
+     */
+    for (;;)
     {
-        if (pBundle->cUsed < RT_ELEMENTS(pBundle->aMem))
+        bool        fNeedBundle;
+        bool        fGrowHash;
+        uint32_t    cShiftCur;
+
+        RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
+        cShiftCur   = pSession->cMemHashShift;
+        fNeedBundle = !pSession->pBundleFree && !pBundleNew;
+        fGrowHash   =    (!cShiftCur && !papHashNew) /* the initial tables */
+                     || (   !fGrowFailed
+                         && cShiftCur < SUPDRV_MEM_HASH_SHIFT_MAX
+                         && pSession->cMemRefs >= (UINT32_C(2) << cShiftCur)
+                         && cShiftNew <= cShiftCur);
+        if (!fNeedBundle && !fGrowHash)
+            break;
+        RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
+
+        if (fNeedBundle)
+        {
+            pBundleNew = (PSUPDRVBUNDLE)RTMemAllocZ(sizeof(*pBundleNew));
+            if (!pBundleNew)
+            {
+                RTMemFree(papHashNew);
+                return VERR_NO_MEMORY;
+            }
+        }
+
+        if (fGrowHash)
         {
-            unsigned i;
-            for (i = 0; i < RT_ELEMENTS(pBundle->aMem); i++)
+            RTMemFree(papHashNew);
+            cShiftNew  = cShiftCur ? cShiftCur + 1 : SUPDRV_MEM_HASH_SHIFT_MIN;
+            papHashNew = (PSUPDRVMEMREF *)RTMemAllocZ(sizeof(PSUPDRVMEMREF) * (UINT32_C(2) << cShiftNew));
+            if (!papHashNew)
             {
-                if (pBundle->aMem[i].MemObj == NIL_RTR0MEMOBJ)
+                cShiftNew = 0;
+                if (!cShiftCur)
                 {
-                    pBundle->cUsed++;
-                    pBundle->aMem[i] = *pMem;
-                    RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
-                    return VINF_SUCCESS;
+                    RTMemFree(pBundleNew);
+                    return VERR_NO_MEMORY;
                 }
+                fGrowFailed = true; /* keep going with the current tables. */
             }
-            AssertFailed();             /* !!this can't be happening!!! */
         }
     }
-    RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
 
     /*
-     * Need to allocate a new bundle.
-     * Insert into the last entry in the bundle.
+     * We own the spinlock now. Install the new hash tables and bundle.
      */
-    pBundle = (PSUPDRVBUNDLE)RTMemAllocZ(sizeof(*pBundle));
-    if (!pBundle)
-        return VERR_NO_MEMORY;
+    if (papHashNew && cShiftNew > pSession->cMemHashShift)
+    {
+        papHashOld = supdrvMemRehashLocked(pSession, papHashNew, cShiftNew);
+        papHashNew = NULL;
+    }
+    if (pBundleNew && !pSession->pBundleFree)
+    {
+        pBundleNew->pNext       = pSession->Bundle.pNext;
+        pSession->Bundle.pNext  = pBundleNew;
+        pBundleNew->pNextFree   = NULL;
+        pSession->pBundleFree   = pBundleNew;
+        pBundleNew = NULL;
+    }
 
-    /* take last entry. */
-    pBundle->cUsed++;
-    pBundle->aMem[RT_ELEMENTS(pBundle->aMem) - 1] = *pMem;
+    /*
+     * Take a free entry in the first bundle on the free list and index it.
+     */
+    pBundle = pSession->pBundleFree;
+    iEntry = ASMBitFirstClear(&pBundle->bmUsed[0], RT_ELEMENTS(pBundle->aMem));
+    AssertReleaseMsg(iEntry >= 0 && pBundle->aMem[iEntry].MemObj == NIL_RTR0MEMOBJ, ("iEntry=%d cUsed=%u\n", iEntry, pBundle->cUsed));
+    ASMBitSet(&pBundle->bmUsed[0], iEntry);
+    if (++pBundle->cUsed >= RT_ELEMENTS(pBundle->aMem))
+    {
+        pSession->pBundleFree = pBundle->pNextFree;
+        pBundle->pNextFree    = NULL;
+    }
 
-    /* insert into list. */
-    RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    pBundle->pNext = pSession->Bundle.pNext;
-    pSession->Bundle.pNext = pBundle;
+    pEntry = &pBundle->aMem[iEntry];
+    *pEntry = *pMem;
+    pEntry->pBundle = pBundle;
+    supdrvMemHashInsertLocked(pSession, pEntry);
+    pSession->cMemRefs++;
     RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
 
+    RTMemFree(papHashOld);
+    RTMemFree(papHashNew);
+    RTMemFree(pBundleNew);
     return VINF_SUCCESS;
 }
 
@@ -3538,8 +4000,8 @@ static int supdrvMemAdd(PSUPDRVMEMREF pMem, PSUPDRVSESSION pSession)
  */
 static int supdrvMemRelease(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, SUPDRVMEMREFTYPE eType)
 {
-    PSUPDRVBUNDLE pBundle;
     RTSPINLOCKTMP SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+    PSUPDRVMEMREF pEntry;
 
     /*
      * Validate input.
@@ -3551,44 +4013,47 @@ static int supdrvMemRelease(PSUPDRVSESSION pSession, RTHCUINTPTR uPtr, SUPDRVMEM
     }
 
     /*
-     * Search for the address.
+     * Look up the address.
      */
     RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
-    for (pBundle = &pSession->Bundle; pBundle; pBundle = pBundle->pNext)
+    pEntry = supdrvMemLookupR0Locked(pSession, uPtr, eType);
+    if (!pEntry)
+        pEntry = supdrvMemLookupR3Locked(pSession, (RTR3PTR)uPtr, eType);
+    if (pEntry)
     {
-        if (pBundle->cUsed > 0)
+        /* Make a copy of it, unlink it and release it outside the spinlock. */
+        PSUPDRVBUNDLE   pBundle = pEntry->pBundle;
+        SUPDRVMEMREF    Mem     = *pEntry;
+
+        supdrvMemHashRemoveLocked(pSession, pEntry);
+        pEntry->eType    = MEMREF_TYPE_UNUSED;
+        pEntry->MemObj   = NIL_RTR0MEMOBJ;
+        pEntry->MapObjR3 = NIL_RTR0MEMOBJ;
+        pEntry->uPtrR0   = 0;
+        pEntry->pvR3     = NIL_RTR3PTR;
+        pEntry->pBundle  = NULL;
+
+        ASMBitClear(&pBundle->bmUsed[0], (int32_t)(pEntry - &pBundle->aMem[0]));
+        if (pBundle->cUsed-- >= RT_ELEMENTS(pBundle->aMem))
         {
-            unsigned i;
-            for (i = 0; i < RT_ELEMENTS(pBundle->aMem); i++)
-            {
-                if (    pBundle->aMem[i].eType == eType
-                    &&  pBundle->aMem[i].MemObj != NIL_RTR0MEMOBJ
-                    &&  (   (RTHCUINTPTR)RTR0MemObjAddress(pBundle->aMem[i].MemObj) == uPtr
-                         || (   pBundle->aMem[i].MapObjR3 != NIL_RTR0MEMOBJ
-                             && RTR0MemObjAddressR3(pBundle->aMem[i].MapObjR3) == uPtr))
-                   )
-                {
-                    /* Make a copy of it and release it outside the spinlock. */
-                    SUPDRVMEMREF Mem = pBundle->aMem[i];
-                    pBundle->aMem[i].eType = MEMREF_TYPE_UNUSED;
-                    pBundle->aMem[i].MemObj = NIL_RTR0MEMOBJ;
-                    pBundle->aMem[i].MapObjR3 = NIL_RTR0MEMOBJ;
-                    RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
+            /* It was full, put it back on the free list. */
+            pBundle->pNextFree    = pSession->pBundleFree;
+            pSession->pBundleFree = pBundle;
+        }
+        pSession->cMemRefs--;
+        RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
 
-                    if (Mem.MapObjR3 != NIL_RTR0MEMOBJ)
-                    {
-                        int rc = RTR0MemObjFree(Mem.MapObjR3, false);
-                        AssertRC(rc); /** @todo figure out how to handle this. */
-                    }
-                    if (Mem.MemObj != NIL_RTR0MEMOBJ)
-                    {
-                        int rc = RTR0MemObjFree(Mem.MemObj, true /* fFreeMappings */);
-                        AssertRC(rc); /** @todo figure out how to handle this. */
-                    }
-                    return VINF_SUCCESS;
-                }
-            }
+        if (Mem.MapObjR3 != NIL_RTR0MEMOBJ)
+        {
+            int rc = RTR0MemObjFree(Mem.MapObjR3, false);
+            AssertRC(rc); /** @todo figure out how to handle this. */
+        }
+        if (Mem.MemObj != NIL_RTR0MEMOBJ)
+        {
+            int rc = RTR0MemObjFree(Mem.MemObj, true /* fFreeMappings */);
+            AssertRC(rc); /** @todo figure out how to handle this. */
         }
+        return VINF_SUCCESS;
     }
     RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
     Log(("Failed to find %p!!! (eType=%d)\n", (void *)uPtr, eType));
@@ -3989,28 +4454,36 @@ static int supdrvIOCtl_LdrFree(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, P
          * clean things up in the right order and not leave them all dangling.
          */
         RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
-        RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
+        unsigned        i;
         if (pImage->cUsage <= 1)
         {
-            PSUPDRVOBJ pObj;
-            for (pObj = pDevExt->pObjs; pObj; pObj = pObj->pNext)
-                if (RT_UNLIKELY((uintptr_t)pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
-                {
-                    rc = VERR_DANGLING_OBJECTS;
-                    break;
-                }
+            for (i = 0; i < RT_ELEMENTS(pDevExt->aObjShards) && rc == VINF_SUCCESS; i++)
+            {
+                PSUPDRVOBJSHARD pShard = &pDevExt->aObjShards[i];
+                PSUPDRVOBJ      pObj;
+                RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
+                for (pObj = pShard->s.pObjs; pObj; pObj = pObj->pNext)
+                    if (RT_UNLIKELY((uintptr_t)pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
+                    {
+                        rc = VERR_DANGLING_OBJECTS;
+                        break;
+                    }
+                RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
+            }
         }
         else
         {
             PSUPDRVUSAGE pGenUsage;
-            for (pGenUsage = pSession->pUsage; pGenUsage; pGenUsage = pGenUsage->pNext)
-                if (RT_UNLIKELY((uintptr_t)pGenUsage->pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
-                {
-                    rc = VERR_DANGLING_OBJECTS;
-                    break;
-                }
+            RTSpinlockAcquire(pSession->Spinlock, &SpinlockTmp);
+            for (i = 0; i < RT_ELEMENTS(pSession->apUsageHash) && rc == VINF_SUCCESS; i++)
+                for (pGenUsage = pSession->apUsageHash[i]; pGenUsage; pGenUsage = pGenUsage->pNext)
+                    if (RT_UNLIKELY((uintptr_t)pGenUsage->pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
+                    {
+                        rc = VERR_DANGLING_OBJECTS;
+                        break;
+                    }
+            RTSpinlockRelease(pSession->Spinlock, &SpinlockTmp);
         }
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
         if (rc == VINF_SUCCESS)
         {
             /* unlink it */
@@ -4343,19 +4816,25 @@ static void supdrvLdrFree(PSUPDRVDEVEXT pDevExt, PSUPDRVLDRIMAGE pImage)
         supdrvLdrUnsetVMMR0EPs(pDevExt);
 
     /* check for objects with destructors in this image. (Shouldn't happen.) */
-    if (pDevExt->pObjs)
     {
         unsigned        cObjs = 0;
-        PSUPDRVOBJ      pObj;
-        RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
-        RTSpinlockAcquire(pDevExt->Spinlock, &SpinlockTmp);
-        for (pObj = pDevExt->pObjs; pObj; pObj = pObj->pNext)
-            if (RT_UNLIKELY((uintptr_t)pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
-            {
-                pObj->pfnDestructor = NULL;
-                cObjs++;
-            }
-        RTSpinlockRelease(pDevExt->Spinlock, &SpinlockTmp);
+        unsigned        i;
+        for (i = 0; i < RT_ELEMENTS(pDevExt->aObjShards); i++)
+        {
+            PSUPDRVOBJSHARD pShard = &pDevExt->aObjShards[i];
+            PSUPDRVOBJ      pObj;
+            RTSPINLOCKTMP   SpinlockTmp = RTSPINLOCKTMP_INITIALIZER;
+            if (!pShard->s.pObjs)
+                continue;
+            RTSpinlockAcquire(pShard->s.Spinlock, &SpinlockTmp);
+            for (pObj = pShard->s.pObjs; pObj; pObj = pObj->pNext)
+                if (RT_UNLIKELY((uintptr_t)pObj->pfnDestructor - (uintptr_t)pImage->pvImage < pImage->cbImageBits))
+                {
+                    pObj->pfnDestructor = NULL;
+                    cObjs++;
+                }
+            RTSpinlockRelease(pShard->s.Spinlock, &SpinlockTmp);
+        }
         if (cObjs)
             OSDBGPRINT(("supdrvLdrFree: Image '%s' has %d dangling objects!\n", pImage->szName, cObjs));
     }
@@ -103,6 +103,8 @@
 #define SUP_IOCTL_FAST_DO_HWACC_RUN             SUP_CTL_CODE_FAST(65)
 /** Just a NOP call for profiling the latency of a fast ioctl call to VMMR0. */
 #define SUP_IOCTL_FAST_DO_NOP                   SUP_CTL_CODE_FAST(66)
+/** Fast path IOCtl: Run a batch of fast VMMR0 operations, see SUPFASTBATCH. */
+#define SUP_IOCTL_FAST_DO_BATCH                 SUP_CTL_CODE_FAST(67)
 
 
 
@@ -192,7 +194,7 @@ typedef SUPREQHDR *PSUPREQHDR;
  * @todo Pending work on next major version change:
  *          - Nothing.
  */
-#define SUPDRV_IOC_VERSION                              0x00140001
+#define SUPDRV_IOC_VERSION                              0x00140002
 
 /** SUP_IOCTL_COOKIE. */
 typedef struct SUPCOOKIE
@@ -1108,6 +1110,48 @@ typedef struct SUPVTCAPS
 } SUPVTCAPS, *PSUPVTCAPS;
 /** @} */
 
+
+/** @name SUP_IOCTL_FAST_DO_BATCH
+ * Runs a batch of fast VMMR0 operations in one kernel entry.
+ *
+ * The ioctl argument is the ring-3 address of a SUPFASTBATCH structure
+ * instead of the VMCPU id. All entries must be for the same VMCPU, which the
+ * calling thread must be the EMT of, just like with the single fast ioctls.
+ * All but the last entry must be SUP_VMMR0_DO_NOP.  The last entry may be
+ * SUP_VMMR0_DO_RAW_RUN or SUP_VMMR0_DO_HWACC_RUN, since these return to
+ * ring-3 when the exit needs servicing there.
+ *
+ * The whole batch is validated before anything is run; a batch breaking the
+ * rules fails with VERR_INVALID_PARAMETER and nothing is executed.
+ * @{
+ */
+/** The max number of entries in a SUPFASTBATCH. */
+#define SUP_FAST_BATCH_MAX_ENTRIES                      16
+/** A SUP_IOCTL_FAST_DO_BATCH entry. */
+typedef struct SUPFASTBATCHENTRY
+{
+    /** The VMCPU id to run the operation on. */
+    VMCPUID                 idCpu;
+    /** The operation, one of the SUP_VMMR0_DO_* values. */
+    uint32_t                uOperation;
+    /** The status of this entry, out direction only. VINF_SUCCESS once the
+     * operation has been dispatched.  The fast VMMR0 operations don't return
+     * a status of their own; as with the single fast ioctls, the outcome of
+     * a run is found in the VMCPU structure. */
+    int32_t                 rc;
+} SUPFASTBATCHENTRY, *PSUPFASTBATCHENTRY;
+/** SUP_IOCTL_FAST_DO_BATCH argument. */
+typedef struct SUPFASTBATCH
+{
+    /** The number of valid entries in aEntries. */
+    uint32_t                cEntries;
+    /** Reserved, MBZ. */
+    uint32_t                u32Reserved;
+    /** The entries. */
+    SUPFASTBATCHENTRY       aEntries[SUP_FAST_BATCH_MAX_ENTRIES];
+} SUPFASTBATCH, *PSUPFASTBATCH;
+/** @} */
+
 #pragma pack()                          /* paranoia */
 
 #endif
@@ -169,6 +169,12 @@
 # define SUPDRV_USE_MUTEX_FOR_GIP
 #endif
 
+#if defined(RT_OS_LINUX) && !defined(SUPDRV_AGNOSTIC)
+/** The number of request buffer size classes cached per session by the
+ * Linux I/O control code. */
+# define SUPDRV_LINUX_REQ_BUF_CLASSES   3
+#endif
+
 
 /**
  * OS debug print macro.
@@ -187,6 +193,25 @@
 /** @} */
 
 
+/** The number of buckets in the per-session object usage hash table. */
+#define SUPDRV_USAGE_HASH_SIZE          32
+/** Calculates the SUPDRVSESSION::apUsageHash index of an object.
+ * @param   pObj    The object. */
+#define SUPDRV_USAGE_HASH(pObj)         ( (((uintptr_t)(pObj) >> 4) ^ ((uintptr_t)(pObj) >> 10)) % SUPDRV_USAGE_HASH_SIZE )
+
+/** The cache line size assumed when laying out hot structures. */
+#define SUPDRV_CACHE_LINE_SIZE          64
+/** The number of object list shards in the device extension. */
+#define SUPDRV_OBJ_SHARDS               16
+/** Calculates the SUPDRVDEVEXT::aObjShards index of an object.
+ * @param   pObj    The object. */
+#define SUPDRV_OBJ_SHARD(pObj)          ( (((uintptr_t)(pObj) >> 6) ^ ((uintptr_t)(pObj) >> 12)) % SUPDRV_OBJ_SHARDS )
+/** The number of usage records moved between a shard cache and the central
+ * free pool at a time. A shard cache holding more than twice this gives a
+ * batch back to the pool. */
+#define SUPDRV_USAGE_BATCH              16
+
+
 /**
  * Validates a session pointer.
  *
@@ -239,6 +264,18 @@ typedef struct SUPDRVMEMREF
     RTR0MEMOBJ                      MapObjR3;
     /** Type of memory. */
     SUPDRVMEMREFTYPE                eType;
+
+    /** The ring-0 address of MemObj, cached by supdrvMemAdd for the index. */
+    RTHCUINTPTR                     uPtrR0;
+    /** The ring-3 address (of MapObjR3 or else MemObj), cached by supdrvMemAdd
+     * for the index. NIL_RTR3PTR if none. */
+    RTR3PTR                         pvR3;
+    /** The bundle this entry lives in. */
+    struct SUPDRVBUNDLE            *pBundle;
+    /** Next entry in the ring-0 address hash chain. */
+    struct SUPDRVMEMREF            *pNextHashR0;
+    /** Next entry in the ring-3 address hash chain. */
+    struct SUPDRVMEMREF            *pNextHashR3;
 } SUPDRVMEMREF, *PSUPDRVMEMREF;
 
 
@@ -249,12 +286,21 @@ typedef struct SUPDRVBUNDLE
 {
     /** Pointer to the next bundle. */
     struct SUPDRVBUNDLE * volatile  pNext;
+    /** Pointer to the next bundle with free entries (SUPDRVSESSION::pBundleFree). */
+    struct SUPDRVBUNDLE            *pNextFree;
     /** Referenced memory. */
     SUPDRVMEMREF                    aMem[64];
+    /** Bitmap of the used aMem entries. */
+    uint32_t                        bmUsed[64 / 32];
     /** Number of entries used. */
     uint32_t volatile   cUsed;
 } SUPDRVBUNDLE, *PSUPDRVBUNDLE;
 
+/** The initial log2 size of the session memory reference hash tables. */
+#define SUPDRV_MEM_HASH_SHIFT_MIN       6
+/** The maximum log2 size of the session memory reference hash tables. */
+#define SUPDRV_MEM_HASH_SHIFT_MAX       16
+
 
 /**
  * Loaded image.
@@ -348,7 +394,7 @@ typedef struct SUPDRVOBJ
     uint32_t                        u32Magic;
     /** The object type. */
     SUPDRVOBJTYPE                   enmType;
-    /** Pointer to the next in the global list. */
+    /** Pointer to the next in the shard list. */
     struct SUPDRVOBJ * volatile     pNext;
     /** Pointer to the object destructor.
      * This may be set to NULL if the image containing the destructor get unloaded. */
@@ -357,7 +403,9 @@ typedef struct SUPDRVOBJ
     void                           *pvUser1;
     /** User argument 2. */
     void                           *pvUser2;
-    /** The total sum of all per-session usage. */
+    /** The total sum of all per-session usage.
+     * This is updated atomically; the 0 transition (destruction) only happens
+     * while owning the SUPDRVOBJSHARD::Spinlock of the object. */
     uint32_t volatile               cUsage;
     /** The creator user id. */
     RTUID                           CreatorUid;
@@ -377,7 +425,7 @@ typedef struct SUPDRVOBJ
  */
 typedef struct SUPDRVUSAGE
 {
-    /** Pointer to the next in the list. */
+    /** Pointer to the next in the hash chain or free list. */
     struct SUPDRVUSAGE * volatile   pNext;
     /** Pointer to the object we're recording usage for. */
     PSUPDRVOBJ                      pObj;
@@ -386,6 +434,38 @@ typedef struct SUPDRVUSAGE
 } SUPDRVUSAGE, *PSUPDRVUSAGE;
 
 
+/**
+ * Object list shard.
+ *
+ * The registered objects are spread over a number of these according to
+ * their address so that object registration, first reference, destruction
+ * and session cleanup don't all serialize on a single lock. The shards are
+ * cache line sized and SUPDRVDEVEXT::aObjShards is cache line aligned, so the
+ * list heads and usage record caches of different shards don't share lines.
+ * The spinlock is an IPRT handle though; the lock word itself lives in the
+ * structure RTSpinlockCreate allocates and may share a line with other
+ * small allocations.
+ */
+typedef union SUPDRVOBJSHARD
+{
+    struct
+    {
+        /** Spinlock protecting this shard. Taken before SUPDRVSESSION::Spinlock. */
+        RTSPINLOCK                  Spinlock;
+        /** List of registered objects hashing to this shard. */
+        PSUPDRVOBJ volatile         pObjs;
+        /** Cache of free usage records. */
+        PSUPDRVUSAGE                pUsageFree;
+        /** Number of records in the pUsageFree cache. */
+        uint32_t                    cUsageFree;
+    } s;
+    /** Padding. */
+    uint8_t                         abPadding[SUPDRV_CACHE_LINE_SIZE];
+} SUPDRVOBJSHARD;
+/** Pointer to an object list shard. */
+typedef SUPDRVOBJSHARD *PSUPDRVOBJSHARD;
+
+
 /**
  * Per session data.
  * This is mainly for memory tracking.
@@ -405,7 +485,8 @@ typedef struct SUPDRVSESSION
     /** Load usage records. (protected by SUPDRVDEVEXT::mtxLdr) */
     PSUPDRVLDRUSAGE volatile        pLdrUsage;
 
-    /** Spinlock protecting the bundles and the GIP members. */
+    /** Spinlock protecting the bundles, the memory reference index, the usage
+     * records and the GIP members. */
     RTSPINLOCK                      Spinlock;
     /** The ring-3 mapping of the GIP (readonly). */
     RTR0MEMOBJ                      GipMapObjR3;
@@ -413,8 +494,23 @@ typedef struct SUPDRVSESSION
     uint32_t                        fGipReferenced;
     /** Bundle of locked memory objects. */
     SUPDRVBUNDLE                    Bundle;
-    /** List of generic usage records. (protected by SUPDRVDEVEXT::SpinLock) */
-    PSUPDRVUSAGE volatile           pUsage;
+    /** List of bundles with free entries, linked by SUPDRVBUNDLE::pNextFree. */
+    PSUPDRVBUNDLE                   pBundleFree;
+    /** Hash table of the memory references keyed by ring-0 address.
+     * This and papMemHashR3 are allocated as one block of
+     * 2 << cMemHashShift entries. */
+    PSUPDRVMEMREF                  *papMemHashR0;
+    /** Hash table of the memory references keyed by ring-3 address. */
+    PSUPDRVMEMREF                  *papMemHashR3;
+    /** The log2 size of the hash tables, 0 if not allocated yet. */
+    uint32_t                        cMemHashShift;
+    /** Number of memory references in the bundles. */
+    uint32_t                        cMemRefs;
+    /** Hash table of the generic usage records, keyed by object and chained
+     * by SUPDRVUSAGE::pNext. (Protected by Spinlock; when adding the first or
+     * removing the last reference a session has to an object, the
+     * SUPDRVOBJSHARD::Spinlock of the object must be taken first.) */
+    PSUPDRVUSAGE                    apUsageHash[SUPDRV_USAGE_HASH_SIZE];
 
     /** The user id of the session. (Set by the OS part.) */
     RTUID                           Uid;
@@ -441,6 +537,11 @@ typedef struct SUPDRVSESSION
     /** Pointer to the next session with the same hash. */
     PSUPDRVSESSION                  pNextHash;
 # endif
+# if defined(RT_OS_LINUX)
+    /** Cached request buffers for the slow I/O control path, one for each
+     * size class. Claimed and returned using atomic exchange. */
+    void * volatile                 apvReqBufCache[SUPDRV_LINUX_REQ_BUF_CLASSES];
+# endif
 #endif /* !SUPDRV_AGNOSTIC */
 } SUPDRVSESSION;
 
@@ -450,13 +551,23 @@ typedef struct SUPDRVSESSION
  */
 typedef struct SUPDRVDEVEXT
 {
-    /** Spinlock to serialize the initialization, usage counting and objects. */
+    /** Spinlock to serialize the initialization and usage counting. */
     RTSPINLOCK                      Spinlock;
-
-    /** List of registered objects. Protected by the spinlock. */
-    PSUPDRVOBJ volatile             pObjs;
-    /** List of free object usage records. */
-    PSUPDRVUSAGE volatile           pUsageFree;
+    /** Alignment padding for aObjShards. */
+    uint8_t                         abAlignment0[SUPDRV_CACHE_LINE_SIZE - sizeof(RTSPINLOCK)];
+
+    /** The registered objects, sharded by address. Cache line aligned,
+     * provided the device extension itself is. */
+    SUPDRVOBJSHARD                  aObjShards[SUPDRV_OBJ_SHARDS];
+    /** Spinlock protecting the central pool of free usage records.
+     * This is only taken while owning a SUPDRVOBJSHARD::Spinlock and no other
+     * lock may be taken while owning it. */
+    RTSPINLOCK                      UsageFreeSpinlock;
+    /** The central pool of free object usage records. Shard caches are
+     * refilled from and drained to this in SUPDRV_USAGE_BATCH sized batches. */
+    PSUPDRVUSAGE                    pUsageFree;
+    /** Number of records in the pUsageFree pool. */
+    uint32_t                        cUsageFree;
 
     /** Global cookie. */
     uint32_t                        u32Cookie;
@@ -524,6 +635,8 @@ typedef struct SUPDRVDEVEXT
 # endif
 #endif
 } SUPDRVDEVEXT;
+AssertCompileSize(SUPDRVOBJSHARD, SUPDRV_CACHE_LINE_SIZE);
+AssertCompileMemberAlignment(SUPDRVDEVEXT, aObjShards, SUPDRV_CACHE_LINE_SIZE);
 
 
 RT_C_DECLS_BEGIN
@@ -592,6 +705,7 @@ void VBOXCALL   supdrvOSLdrUnload(PSUPDRVDEVEXT pDevExt, PSUPDRVLDRIMAGE pImage)
 /* SUPDrv.c */
 int  VBOXCALL   supdrvIOCtl(uintptr_t uIOCtl, PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPREQHDR pReqHdr);
 int  VBOXCALL   supdrvIOCtlFast(uintptr_t uIOCtl, VMCPUID idCpu, PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession);
+int  VBOXCALL   supdrvIOCtlFastBatch(PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPFASTBATCH pBatch);
 int  VBOXCALL   supdrvIDC(uintptr_t uIOCtl, PSUPDRVDEVEXT pDevExt, PSUPDRVSESSION pSession, PSUPDRVIDCREQHDR pReqHdr);
 int  VBOXCALL   supdrvInitDevExt(PSUPDRVDEVEXT pDevExt, size_t cbSession);
 void VBOXCALL   supdrvDeleteDevExt(PSUPDRVDEVEXT pDevExt);
@@ -146,6 +146,10 @@ static long VBoxDrvLinuxIOCtl(struct file *pFilp, unsigned int uCmd, unsigned lo
 static int  VBoxDrvLinuxIOCtl(struct inode *pInode, struct file *pFilp, unsigned int uCmd, unsigned long ulArg);
 #endif
 static int  VBoxDrvLinuxIOCtlSlow(struct file *pFilp, unsigned int uCmd, unsigned long ulArg);
+static int  VBoxDrvLinuxIOCtlFastBatch(PSUPDRVSESSION pSession, unsigned long ulArg);
+static PSUPREQHDR vboxdrvLinuxReqBufAlloc(PSUPDRVSESSION pSession, unsigned int uCmd, uint32_t cbBuf, unsigned *piClass);
+static void vboxdrvLinuxReqBufFree(PSUPDRVSESSION pSession, PSUPREQHDR pHdr, unsigned iClass);
+static void vboxdrvLinuxReqBufPurge(PSUPDRVSESSION pSession);
 static int  VBoxDrvLinuxErr2LinuxErr(int);
 #ifdef VBOX_WITH_SUSPEND_NOTIFICATION
 static int  VBoxDrvProbe(struct platform_device *pDev);
@@ -165,8 +169,9 @@ static void VBoxDevRelease(struct device *pDev);
 *******************************************************************************/
 /**
  * Device extention & session data association structure.
+ * Cache line aligned for the sake of SUPDRVDEVEXT::aObjShards.
  */
-static SUPDRVDEVEXT         g_DevExt;
+static SUPDRVDEVEXT         g_DevExt __attribute__((__aligned__(SUPDRV_CACHE_LINE_SIZE)));
 
 #ifndef CONFIG_VBOXDRV_AS_MISC
 /** Module major number */
@@ -179,6 +184,18 @@ static int                  g_iModuleMajor;
  * Not prefixed because the name is used by macros and the end of this file. */
 static int force_async_tsc = 0;
 
+/** Module parameter: Whether to cache slow ioctl request buffers in the session. */
+static int ioctl_buf_cache = 1;
+/** Module parameter (read-only): The number of slow ioctls processed. */
+static unsigned int ioctl_slow_count = 0;
+/** Module parameter (read-only): The number of request buffers the slow
+ * ioctls had to get from the allocator. */
+static unsigned int ioctl_slow_allocs = 0;
+
+/** The sizes of the request buffer classes cached by vboxdrvLinuxReqBufAlloc.
+ * Requests larger than the last class always go to the allocator. */
+static const uint32_t g_acbReqBufClasses[SUPDRV_LINUX_REQ_BUF_CLASSES] = { 256, _4K, _64K };
+
 /** The module name. */
 #define DEVICE_NAME         "vboxdrv"
 
@@ -689,6 +706,7 @@ static int VBoxDrvLinuxClose(struct inode *pInode, struct file *pFilp)
 {
     Log(("VBoxDrvLinuxClose: pFilp=%p pSession=%p pid=%d/%d %s\n",
          pFilp, pFilp->private_data, RTProcSelf(), current->pid, current->comm));
+    vboxdrvLinuxReqBufPurge((PSUPDRVSESSION)pFilp->private_data);
     supdrvCloseSession(&g_DevExt, (PSUPDRVSESSION)pFilp->private_data);
     pFilp->private_data = NULL;
     return 0;
@@ -770,6 +788,8 @@ static int VBoxDrvLinuxIOCtl(struct inode *pInode, struct file *pFilp, unsigned
                   || uCmd == SUP_IOCTL_FAST_DO_HWACC_RUN
                   || uCmd == SUP_IOCTL_FAST_DO_NOP))
         return supdrvIOCtlFast(uCmd, ulArg, &g_DevExt, (PSUPDRVSESSION)pFilp->private_data);
+    if (uCmd == SUP_IOCTL_FAST_DO_BATCH)
+        return VBoxDrvLinuxIOCtlFastBatch((PSUPDRVSESSION)pFilp->private_data, ulArg);
     return VBoxDrvLinuxIOCtlSlow(pFilp, uCmd, ulArg);
 
 #else   /* !HAVE_UNLOCKED_IOCTL */
@@ -780,6 +800,8 @@ static int VBoxDrvLinuxIOCtl(struct inode *pInode, struct file *pFilp, unsigned
                   || uCmd == SUP_IOCTL_FAST_DO_HWACC_RUN
                   || uCmd == SUP_IOCTL_FAST_DO_NOP))
         rc = supdrvIOCtlFast(uCmd, ulArg, &g_DevExt, (PSUPDRVSESSION)pFilp->private_data);
+    else if (uCmd == SUP_IOCTL_FAST_DO_BATCH)
+        rc = VBoxDrvLinuxIOCtlFastBatch((PSUPDRVSESSION)pFilp->private_data, ulArg);
     else
         rc = VBoxDrvLinuxIOCtlSlow(pFilp, uCmd, ulArg);
     lock_kernel();
@@ -788,6 +810,118 @@ static int VBoxDrvLinuxIOCtl(struct inode *pInode, struct file *pFilp, unsigned
 }
 
 
+/**
+ * Device I/O Control entry point for SUP_IOCTL_FAST_DO_BATCH.
+ *
+ * Like the other fast ioctls this returns a VBox status code.
+ *
+ * @param   pSession    The session.
+ * @param   ulArg       The ring-3 address of the SUPFASTBATCH structure.
+ */
+static int VBoxDrvLinuxIOCtlFastBatch(PSUPDRVSESSION pSession, unsigned long ulArg)
+{
+    int             rc;
+    SUPFASTBATCH    Batch;
+    size_t          cbEntries;
+
+    if (RT_UNLIKELY(copy_from_user(&Batch, (void *)ulArg, RT_OFFSETOF(SUPFASTBATCH, aEntries))))
+        return VERR_INVALID_POINTER;
+    if (RT_UNLIKELY(Batch.cEntries > RT_ELEMENTS(Batch.aEntries)))
+        return VERR_INVALID_PARAMETER;
+    cbEntries = Batch.cEntries * sizeof(Batch.aEntries[0]);
+    if (RT_UNLIKELY(copy_from_user(&Batch.aEntries[0], (uint8_t *)ulArg + RT_OFFSETOF(SUPFASTBATCH, aEntries), cbEntries)))
+        return VERR_INVALID_POINTER;
+
+    rc = supdrvIOCtlFastBatch(&g_DevExt, pSession, &Batch);
+
+    if (    RT_SUCCESS(rc)
+        &&  RT_UNLIKELY(copy_to_user((uint8_t *)ulArg + RT_OFFSETOF(SUPFASTBATCH, aEntries), &Batch.aEntries[0], cbEntries)))
+        rc = VERR_INVALID_POINTER;
+    return rc;
+}
+
+
+/**
+ * Gets a request buffer for VBoxDrvLinuxIOCtlSlow.
+ *
+ * Small requests are served from the per-session buffer cache, so the common
+ * ioctls (SUP_IOCTL_CALL_SERVICE, SUP_IOCTL_SEM_OP, SUP_IOCTL_PAGE_LOCK and
+ * friends) don't hit the allocator each time. If several threads of the
+ * session race us for the same class, the losers fall back on the allocator.
+ *
+ * @returns Pointer to the buffer, NULL if out of memory.
+ * @param   pSession    The session.
+ * @param   uCmd        The I/O control function.
+ * @param   cbBuf       The required buffer size.
+ * @param   piClass     Where to return the size class of the buffer for
+ *                      vboxdrvLinuxReqBufFree. UINT_MAX if not cachable.
+ */
+static PSUPREQHDR vboxdrvLinuxReqBufAlloc(PSUPDRVSESSION pSession, unsigned int uCmd, uint32_t cbBuf, unsigned *piClass)
+{
+    void       *pv = NULL;
+    unsigned    iClass = UINT_MAX;
+
+    if (    ioctl_buf_cache
+        &&  uCmd != SUP_IOCTL_LDR_LOAD)
+    {
+        for (iClass = 0; iClass < RT_ELEMENTS(g_acbReqBufClasses); iClass++)
+            if (cbBuf <= g_acbReqBufClasses[iClass])
+                break;
+        if (iClass < RT_ELEMENTS(g_acbReqBufClasses))
+        {
+            pv = ASMAtomicXchgPtr(&pSession->apvReqBufCache[iClass], NULL);
+            if (pv)
+            {
+                *piClass = iClass;
+                return (PSUPREQHDR)pv;
+            }
+            cbBuf = g_acbReqBufClasses[iClass];
+        }
+        else
+            iClass = UINT_MAX;
+    }
+
+    ASMAtomicIncU32(&ioctl_slow_allocs);
+    pv = RTMemAlloc(cbBuf);
+    *piClass = iClass;
+    return (PSUPREQHDR)pv;
+}
+
+
+/**
+ * Returns a request buffer obtained by vboxdrvLinuxReqBufAlloc.
+ *
+ * @param   pSession    The session.
+ * @param   pHdr        The buffer.
+ * @param   iClass      The size class returned by vboxdrvLinuxReqBufAlloc.
+ */
+static void vboxdrvLinuxReqBufFree(PSUPDRVSESSION pSession, PSUPREQHDR pHdr, unsigned iClass)
+{
+    if (    iClass >= RT_ELEMENTS(g_acbReqBufClasses)
+        ||  !ASMAtomicCmpXchgPtr(&pSession->apvReqBufCache[iClass], pHdr, NULL))
+        RTMemFree(pHdr);
+}
+
+
+/**
+ * Frees the request buffers cached by the session.
+ *
+ * @param   pSession    The session, NULL is ignored.
+ */
+static void vboxdrvLinuxReqBufPurge(PSUPDRVSESSION pSession)
+{
+    unsigned i;
+    if (!pSession)
+        return;
+    for (i = 0; i < RT_ELEMENTS(pSession->apvReqBufCache); i++)
+    {
+        void *pv = ASMAtomicXchgPtr(&pSession->apvReqBufCache[i], NULL);
+        if (pv)
+            RTMemFree(pv);
+    }
+}
+
+
 /**
  * Device I/O Control entry point.
  *
@@ -801,6 +935,8 @@ static int VBoxDrvLinuxIOCtlSlow(struct file *pFilp, unsigned int uCmd, unsigned
     SUPREQHDR           Hdr;
     PSUPREQHDR          pHdr;
     uint32_t            cbBuf;
+    unsigned            iClass;
+    PSUPDRVSESSION      pSession = (PSUPDRVSESSION)pFilp->private_data;
 
     Log6(("VBoxDrvLinuxIOCtl: pFilp=%p uCmd=%#x ulArg=%p pid=%d/%d\n", pFilp, uCmd, (void *)ulArg, RTProcSelf(), current->pid));
 
@@ -832,7 +968,8 @@ static int VBoxDrvLinuxIOCtlSlow(struct file *pFilp, unsigned int uCmd, unsigned
         Log(("VBoxDrvLinuxIOCtl: bad ioctl cbBuf=%#x _IOC_SIZE=%#x; uCmd=%#x.\n", cbBuf, _IOC_SIZE(uCmd), uCmd));
         return -EINVAL;
     }
-    pHdr = RTMemAlloc(cbBuf);
+    ASMAtomicIncU32(&ioctl_slow_count);
+    pHdr = vboxdrvLinuxReqBufAlloc(pSession, uCmd, cbBuf, &iClass);
     if (RT_UNLIKELY(!pHdr))
     {
         OSDBGPRINT(("VBoxDrvLinuxIOCtl: failed to allocate buffer of %d bytes for uCmd=%#x.\n", cbBuf, uCmd));
@@ -841,14 +978,14 @@ static int VBoxDrvLinuxIOCtlSlow(struct file *pFilp, unsigned int uCmd, unsigned
     if (RT_UNLIKELY(copy_from_user(pHdr, (void *)ulArg, Hdr.cbIn)))
     {
         Log(("VBoxDrvLinuxIOCtl: copy_from_user(,%#lx, %#x) failed; uCmd=%#x.\n", ulArg, Hdr.cbIn, uCmd));
-        RTMemFree(pHdr);
+        vboxdrvLinuxReqBufFree(pSession, pHdr, iClass);
         return -EFAULT;
     }
 
     /*
      * Process the IOCtl.
      */
-    rc = supdrvIOCtl(uCmd, &g_DevExt, (PSUPDRVSESSION)pFilp->private_data, pHdr);
+    rc = supdrvIOCtl(uCmd, &g_DevExt, pSession, pHdr);
 
     /*
      * Copy ioctl data and output buffer back to user space.
@@ -873,7 +1010,7 @@ static int VBoxDrvLinuxIOCtlSlow(struct file *pFilp, unsigned int uCmd, unsigned
         Log(("VBoxDrvLinuxIOCtl: pFilp=%p uCmd=%#x ulArg=%p failed, rc=%d\n", pFilp, uCmd, (void *)ulArg, rc));
         rc = -EINVAL;
     }
-    RTMemFree(pHdr);
+    vboxdrvLinuxReqBufFree(pSession, pHdr, iClass);
 
     Log6(("VBoxDrvLinuxIOCtl: returns %d (pid=%d/%d)\n", rc, RTProcSelf(), current->pid));
     return rc;
@@ -1041,4 +1178,10 @@ MODULE_VERSION(VBOX_VERSION_STRING " (" RT_XSTR(SUPDRV_IOC_VERSION) ")");
 
 module_param(force_async_tsc, int, 0444);
 MODULE_PARM_DESC(force_async_tsc, "force the asynchronous TSC mode");
+module_param(ioctl_buf_cache, int, 0644);
+MODULE_PARM_DESC(ioctl_buf_cache, "cache small ioctl request buffers in the session");
+module_param(ioctl_slow_count, uint, 0444);
+MODULE_PARM_DESC(ioctl_slow_count, "number of slow ioctls processed");
+module_param(ioctl_slow_allocs, uint, 0444);
+MODULE_PARM_DESC(ioctl_slow_allocs, "number of request buffers allocated by slow ioctls");
 
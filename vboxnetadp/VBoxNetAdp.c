@@ -1053,10 +1053,95 @@ DECLHIDDEN(int) vboxNetAdpInitGlobals(PVBOXNETADPGLOBALS pGlobals)
 
 #else /* !VBOXANETADP_DO_NOT_USE_NETFLT */
 
+#include <VBox/intnetinline.h>
+#include <iprt/asm.h>
+#include <iprt/spinlock.h>
+
+/** The number of buckets in the adapter name hash (power of two). */
+#define VBOXNETADP_NAME_HASH_SIZE   256
+
+AssertCompile(VBOXNETADP_MAX_INSTANCES % 32 == 0 && VBOXNETADP_MAX_INSTANCES <= 32 * 32);
 
+
+/** The adapter slots, indexed by unit number. */
 VBOXNETADP g_aAdapters[VBOXNETADP_MAX_INSTANCES];
+/** Protects the unit bitmaps, the name hash and the slot state transitions. */
+static RTSPINLOCK g_hAdpSpinlock = NIL_RTSPINLOCK;
+/** The units in use, one bit per g_aAdapters entry. */
+static uint32_t g_bmUsedUnits[VBOXNETADP_MAX_INSTANCES / 32];
+/** The g_bmUsedUnits words without a clear bit, so finding a free unit
+ *  takes two bit scans no matter how many adapters there are. */
+static uint32_t g_bmFullWords;
+/** The active adapters hashed by name, chained thru VBOXNETADP::pHashNext. */
+static PVBOXNETADP g_apNameHash[VBOXNETADP_NAME_HASH_SIZE];
+
+
+
+/**
+ * Calculates the name hash bucket of an adapter name.
+ *
+ * @returns Index into g_apNameHash.
+ * @param   pszName     The adapter name.
+ */
+DECLINLINE(uint32_t) vboxNetAdpNameHash(const char *pszName)
+{
+    return IntNetNameHash(pszName) & (VBOXNETADP_NAME_HASH_SIZE - 1);
+}
 
+/**
+ * Grabs the lowest free unit.
+ *
+ * @returns The unit number, -1 if all are taken.
+ * @remarks Caller must own g_hAdpSpinlock.
+ */
+static int vboxNetAdpAllocUnitLocked(void)
+{
+    unsigned iWord = ASMBitFirstSetU32(~g_bmFullWords);
+    unsigned iBit;
+
+    if (!iWord || iWord > RT_ELEMENTS(g_bmUsedUnits))
+        return -1;
+    iWord--;
+    iBit = ASMBitFirstSetU32(~g_bmUsedUnits[iWord]) - 1;
+
+    g_bmUsedUnits[iWord] |= RT_BIT_32(iBit);
+    if (g_bmUsedUnits[iWord] == UINT32_MAX)
+        g_bmFullWords |= RT_BIT_32(iWord);
+    return iWord * 32 + iBit;
+}
+
+/**
+ * Returns a unit to the free pool.
+ *
+ * @param   uUnit       The unit number.
+ * @remarks Caller must own g_hAdpSpinlock.
+ */
+static void vboxNetAdpFreeUnitLocked(uint32_t uUnit)
+{
+    g_bmUsedUnits[uUnit / 32] &= ~RT_BIT_32(uUnit % 32);
+    g_bmFullWords             &= ~RT_BIT_32(uUnit / 32);
+}
 
+/**
+ * Removes an adapter from the name hash.
+ *
+ * @param   pThis       The adapter.
+ * @remarks Caller must own g_hAdpSpinlock.
+ */
+static void vboxNetAdpUnhashLocked(PVBOXNETADP pThis)
+{
+    PVBOXNETADP *ppCur = &g_apNameHash[vboxNetAdpNameHash(pThis->szName)];
+    while (*ppCur)
+    {
+        if (*ppCur == pThis)
+        {
+            *ppCur = pThis->pHashNext;
+            break;
+        }
+        ppCur = &(*ppCur)->pHashNext;
+    }
+    pThis->pHashNext = NULL;
+}
 
 /**
  * Generate a suitable MAC address.
@@ -1072,100 +1157,148 @@ DECLHIDDEN(void) vboxNetAdpComposeMACAddress(PVBOXNETADP pThis, PRTMAC pMac)
     pMac->au8[2] = 0x27;
 
     pMac->au8[3] = 0; /* pThis->uUnit >> 16; */
-    pMac->au8[4] = 0; /* pThis->uUnit >> 8; */
-    pMac->au8[5] = pThis->uUnit;
+    pMac->au8[4] = (uint8_t)(pThis->uUnit >> 8);
+    pMac->au8[5] = (uint8_t)pThis->uUnit;
 }
 
 int vboxNetAdpCreate (PVBOXNETADP *ppNew)
 {
-    int rc;
-    unsigned i;
-    for (i = 0; i < RT_ELEMENTS(g_aAdapters); i++)
+    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
+    PVBOXNETADP   pThis;
+    RTMAC         Mac;
+    int           iUnit;
+    int           rc;
+
+    /*
+     * Take the lowest free unit and reserve its slot.
+     */
+    RTSpinlockAcquire(g_hAdpSpinlock, &Tmp);
+    iUnit = vboxNetAdpAllocUnitLocked();
+    if (iUnit < 0)
     {
-        PVBOXNETADP pThis = &g_aAdapters[i];
+        RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
+        Log(("vboxNetAdpCreate: no empty slots!\n"));
+        /* All slots in adapter array are busy. */
+        return VERR_OUT_OF_RESOURCES;
+    }
+    pThis = &g_aAdapters[iUnit];
+    Assert(pThis->enmState == kVBoxNetAdpState_Invalid);
+    ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Transitional);
+    RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
 
-        if (ASMAtomicCmpXchgU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Transitional, kVBoxNetAdpState_Invalid))
-        {
-            RTMAC Mac;
-            /* Found an empty slot -- use it. */
-            Log(("vboxNetAdpCreate: found empty slot: %d\n", i));
-            vboxNetAdpComposeMACAddress(pThis, &Mac);
-            rc = vboxNetAdpOsCreate(pThis, &Mac);
-            Log(("vboxNetAdpCreate: pThis=%p pThis->szName=%p\n", pThis, pThis->szName));
-            if (RT_SUCCESS(rc))
-            {
-                *ppNew = pThis;
-                ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Active);
-            }
-            else
-            {
-                ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Invalid);
-                Log(("vboxNetAdpCreate: vboxNetAdpOsCreate failed with '%Rrc'.\n", rc));
-            }
-            Log2(("VBoxNetAdpCreate: Created %s\n", g_aAdapters[i].szName));
-            for (i = 0; i < RT_ELEMENTS(g_aAdapters); i++)
-                Log2(("VBoxNetAdpCreate: Scanning entry: state=%d name=%s\n", g_aAdapters[i].enmState, g_aAdapters[i].szName));
-            return rc;
-        }
+    /*
+     * Create the OS interface (this may sleep), then make it visible.
+     */
+    Log(("vboxNetAdpCreate: found empty slot: %d\n", iUnit));
+    vboxNetAdpComposeMACAddress(pThis, &Mac);
+    rc = vboxNetAdpOsCreate(pThis, &Mac);
+    Log(("vboxNetAdpCreate: pThis=%p pThis->szName=%p\n", pThis, pThis->szName));
+
+    RTSpinlockAcquire(g_hAdpSpinlock, &Tmp);
+    if (RT_SUCCESS(rc))
+    {
+        uint32_t const iHash = vboxNetAdpNameHash(pThis->szName);
+        pThis->pHashNext = g_apNameHash[iHash];
+        g_apNameHash[iHash] = pThis;
+        ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Active);
+        *ppNew = pThis;
     }
-    Log(("vboxNetAdpCreate: no empty slots!\n"));
+    else
+    {
+        ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Invalid);
+        vboxNetAdpFreeUnitLocked(pThis->uUnit);
+    }
+    RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
 
-    /* All slots in adapter array are busy. */
-    return VERR_OUT_OF_RESOURCES;
+    if (RT_SUCCESS(rc))
+        Log2(("VBoxNetAdpCreate: Created %s\n", pThis->szName));
+    else
+        Log(("vboxNetAdpCreate: vboxNetAdpOsCreate failed with '%Rrc'.\n", rc));
+    return rc;
 }
 
 int vboxNetAdpDestroy (PVBOXNETADP pThis)
 {
-    int rc = VINF_SUCCESS;
+    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
 
-    if (!ASMAtomicCmpXchgU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Transitional, kVBoxNetAdpState_Active))
+    /*
+     * Take it out of the name hash first so lookups stop finding it.
+     */
+    RTSpinlockAcquire(g_hAdpSpinlock, &Tmp);
+    if (ASMAtomicReadU32((uint32_t volatile *)&pThis->enmState) != kVBoxNetAdpState_Active)
+    {
+        RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
         return VERR_INTNET_FLT_IF_BUSY;
+    }
+    ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Transitional);
+    vboxNetAdpUnhashLocked(pThis);
+    RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
 
     vboxNetAdpOsDestroy(pThis);
+    pThis->szName[0] = '\0';
 
+    RTSpinlockAcquire(g_hAdpSpinlock, &Tmp);
     ASMAtomicWriteU32((uint32_t volatile *)&pThis->enmState, kVBoxNetAdpState_Invalid);
+    vboxNetAdpFreeUnitLocked(pThis->uUnit);
+    RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
 
-    return rc;
+    return VINF_SUCCESS;
 }
 
 int  vboxNetAdpInit(void)
 {
     unsigned i;
+    int rc;
     PVBOXNETADP pVboxnet0;
+
+    rc = RTSpinlockCreate(&g_hAdpSpinlock);
+    if (RT_FAILURE(rc))
+        return rc;
+    memset(g_bmUsedUnits, 0, sizeof(g_bmUsedUnits));
+    g_bmFullWords = 0;
+    memset(g_apNameHash, 0, sizeof(g_apNameHash));
+
     /*
      * Init common members and call OS-specific init.
      */
     for (i = 0; i < RT_ELEMENTS(g_aAdapters); i++)
     {
-        g_aAdapters[i].enmState = kVBoxNetAdpState_Invalid;
-        g_aAdapters[i].uUnit    = i;
+        g_aAdapters[i].enmState  = kVBoxNetAdpState_Invalid;
+        g_aAdapters[i].uUnit     = i;
+        g_aAdapters[i].pHashNext = NULL;
         vboxNetAdpOsInit(&g_aAdapters[i]);
     }
 
     /* Create vboxnet0 */
-    return vboxNetAdpCreate(&pVboxnet0);
+    rc = vboxNetAdpCreate(&pVboxnet0);
+    if (RT_FAILURE(rc))
+    {
+        RTSpinlockDestroy(g_hAdpSpinlock);
+        g_hAdpSpinlock = NIL_RTSPINLOCK;
+    }
+    return rc;
 }
 
 /**
  * Finds an adapter by its name.
  *
  * @returns Pointer to the instance by the given name. NULL if not found.
- * @param   pGlobals        The globals.
  * @param   pszName         The name of the instance.
  */
 PVBOXNETADP vboxNetAdpFindByName(const char *pszName)
 {
-    unsigned i;
+    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
+    PVBOXNETADP   pThis;
 
-    for (i = 0; i < RT_ELEMENTS(g_aAdapters); i++)
+    RTSpinlockAcquire(g_hAdpSpinlock, &Tmp);
+    for (pThis = g_apNameHash[vboxNetAdpNameHash(pszName)]; pThis; pThis = pThis->pHashNext)
     {
-        PVBOXNETADP pThis = &g_aAdapters[i];
         Log2(("VBoxNetAdp: Scanning entry: state=%d name=%s\n", pThis->enmState, pThis->szName));
-        if (   strcmp(pThis->szName, pszName) == 0
-            && ASMAtomicReadU32((uint32_t volatile *)&pThis->enmState) == kVBoxNetAdpState_Active)
-            return pThis;
+        if (strcmp(pThis->szName, pszName) == 0)
+            break;
     }
-    return NULL;
+    RTSpinlockRelease(g_hAdpSpinlock, &Tmp);
+    return pThis;
 }
 
 void vboxNetAdpShutdown(void)
@@ -1174,6 +1307,10 @@ void vboxNetAdpShutdown(void)
 
     /* Remove virtual adapters */
     for (i = 0; i < RT_ELEMENTS(g_aAdapters); i++)
-        vboxNetAdpDestroy(&g_aAdapters[i]);
+        if (g_bmUsedUnits[i / 32] & RT_BIT_32(i % 32))
+            vboxNetAdpDestroy(&g_aAdapters[i]);
+
+    RTSpinlockDestroy(g_hAdpSpinlock);
+    g_hAdpSpinlock = NIL_RTSPINLOCK;
 }
 #endif /* !VBOXANETADP_DO_NOT_USE_NETFLT */
@@ -29,7 +29,7 @@ RT_C_DECLS_BEGIN
 /** Pointer to the globals. */
 typedef struct VBOXNETADPGLOBALS *PVBOXNETADPGLOBALS;
 
-#define VBOXNETADP_MAX_INSTANCES   8
+#define VBOXNETADP_MAX_INSTANCES   1024
 #define VBOXNETADP_NAME            "vboxnet"
 #define VBOXNETADP_MAX_NAME_LEN    32
 #define VBOXNETADP_MTU             1500
@@ -132,6 +132,8 @@ struct VBoxNetAdapter
         uint8_t abPadding[64];
 #endif
     } u;
+    /** The next adapter in the same name hash bucket. */
+    struct VBoxNetAdapter *pHashNext;
     /** The interface name. */
     char szName[VBOXNETADP_MAX_NAME_LEN];
 };
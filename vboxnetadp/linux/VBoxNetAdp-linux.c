@@ -24,6 +24,10 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/miscdevice.h>
+#include <linux/ethtool.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 36)
+# include <linux/u64_stats_sync.h>
+#endif
 
 #define LOG_GROUP LOG_GROUP_NET_ADP_DRV
 #include <VBox/log.h>
@@ -52,6 +56,53 @@
 
 #define VBOXNETADP_FROM_IFACE(iface) ((PVBOXNETADP) ifnet_softc(iface))
 
+#ifndef for_each_possible_cpu
+# define for_each_possible_cpu(cpu) for_each_cpu(cpu)
+#endif
+
+/** The max number of TX/RX queues of an adapter. */
+#define VBOXNETADP_LINUX_MAX_QUEUES 64
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 38)
+# define VBOX_ALLOC_NETDEV_MQS(cbPriv, pszName, pfnSetup, cQueues) \
+    alloc_netdev_mqs(cbPriv, pszName, pfnSetup, cQueues, cQueues)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 23)
+# define VBOX_ALLOC_NETDEV_MQS(cbPriv, pszName, pfnSetup, cQueues) \
+    alloc_netdev_mq(cbPriv, pszName, pfnSetup, cQueues)
+#else
+# define VBOX_ALLOC_NETDEV_MQS(cbPriv, pszName, pfnSetup, cQueues) \
+    alloc_netdev(cbPriv, pszName, pfnSetup)
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)
+# define VBOX_NETIF_START_QUEUES(pNetDev)   netif_tx_start_all_queues(pNetDev)
+# define VBOX_NETIF_STOP_QUEUES(pNetDev)    netif_tx_stop_all_queues(pNetDev)
+#else
+# define VBOX_NETIF_START_QUEUES(pNetDev)   netif_start_queue(pNetDev)
+# define VBOX_NETIF_STOP_QUEUES(pNetDev)    netif_stop_queue(pNetDev)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 36)
+struct u64_stats_sync { int iDummy; };
+# define u64_stats_update_begin(pSync)      do { } while (0)
+# define u64_stats_update_end(pSync)        do { } while (0)
+# define u64_stats_fetch_begin(pSync)       0
+# define u64_stats_fetch_retry(pSync, uSeq) false
+#else
+/** Report the 64-bit counters through ndo_get_stats64. */
+# define VBOXNETADP_WITH_STATS64    1
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+# define u64_stats_init(pSync)              do { } while (0)
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 18)
+/** The offloads we advertise, see the host_offload module parameter. */
+# define VBOXNETADP_LINUX_OFFLOADS  (NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_HIGHDMA | NETIF_F_TSO | NETIF_F_TSO6)
+#else
+# define VBOXNETADP_LINUX_OFFLOADS  (NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_HIGHDMA)
+#endif
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -80,6 +131,17 @@ MODULE_LICENSE("GPL");
 MODULE_VERSION(VBOX_VERSION_STRING " (" RT_XSTR(INTNETTRUNKIFPORT_VERSION) ")");
 #endif
 
+/** Whether to advertise scatter/gather, checksum and TSO offloading to the
+ *  host stack (1) or not (0). */
+static int host_offload = 1;
+module_param(host_offload, int, 0444);
+MODULE_PARM_DESC(host_offload, "let the host stack send unsegmented, unchecksummed frames (applies to new adapters)");
+
+/** The number of TX/RX queues of new adapters, 0 for one per online CPU. */
+static unsigned num_queues = 0;
+module_param(num_queues, uint, 0644);
+MODULE_PARM_DESC(num_queues, "number of TX/RX queues per adapter, 0 for one per online CPU (applies to new adapters)");
+
 /**
  * The (common) global data.
  */
@@ -106,9 +168,43 @@ static struct miscdevice g_CtlDev =
 # endif
 };
 
+/**
+ * Per-CPU transmit statistics of an adapter.
+ *
+ * Only the transmitting CPU writes these (with bottom halves disabled), the
+ * readers sum them up under the u64_stats_sync sequence so 32-bit hosts get
+ * consistent 64-bit values.
+ */
+struct VBoxNetAdpLinuxStats
+{
+    /** The number of frames the host stack sent. */
+    uint64_t                cTxPackets;
+    /** The number of bytes the host stack sent. */
+    uint64_t                cTxBytes;
+    /** The number of GSO frames, i.e. frames left unsegmented thanks to the
+     *  advertised offloads. */
+    uint64_t                cTxGsoFrames;
+    /** The number of segments those GSO frames stand for. */
+    uint64_t                cTxGsoSegs;
+    /** The number of frames sent with the checksum left to us. */
+    uint64_t                cTxCsumOffload;
+    /** Writer/reader synchronization for the counters above. */
+    struct u64_stats_sync   Sync;
+};
+
+typedef struct VBoxNetAdpLinuxStats VBOXNETADPLINUXSTATS;
+typedef VBOXNETADPLINUXSTATS *PVBOXNETADPLINUXSTATS;
+
 struct VBoxNetAdpPriv
 {
+#ifndef VBOXNETADP_WITH_STATS64
+    /** The statistics returned by vboxNetAdpLinuxGetStats, summed up from
+     *  pStats on each call. */
     struct net_device_stats Stats;
+#endif
+    /** Per-CPU transmit statistics (alloc_percpu), updated without
+     *  contention by the CPUs transmitting concurrently. */
+    PVBOXNETADPLINUXSTATS   pStats;
 };
 
 typedef struct VBoxNetAdpPriv VBOXNETADPPRIV;
@@ -116,42 +212,172 @@ typedef VBOXNETADPPRIV *PVBOXNETADPPRIV;
 
 static int vboxNetAdpLinuxOpen(struct net_device *pNetDev)
 {
-    netif_start_queue(pNetDev);
+    VBOX_NETIF_START_QUEUES(pNetDev);
     return 0;
 }
 
 static int vboxNetAdpLinuxStop(struct net_device *pNetDev)
 {
-    netif_stop_queue(pNetDev);
+    VBOX_NETIF_STOP_QUEUES(pNetDev);
     return 0;
 }
 
+/**
+ * Transmits a frame from the host stack.
+ *
+ * The frames are handed to the internal network by the vboxnetflt instance
+ * attached to the adapter, whose ETH_P_ALL packet handler sees them (as
+ * PACKET_OUTGOING) before they get here.  So all that is left to do is the
+ * accounting.  With the offloads advertised the frames arrive unsegmented and
+ * without checksums, and vboxnetflt passes them on as GSO frames or segments
+ * them once.  The queue is lockless (LLTX), so concurrent senders only touch
+ * their own CPU's statistics.
+ *
+ * @returns NETDEV_TX_OK.
+ * @param   pSkb            The frame.  This is consumed.
+ * @param   pNetDev         The adapter.
+ */
 static int vboxNetAdpLinuxXmit(struct sk_buff *pSkb, struct net_device *pNetDev)
 {
-    PVBOXNETADPPRIV pPriv = netdev_priv(pNetDev);
+    PVBOXNETADPPRIV         pPriv  = netdev_priv(pNetDev);
+    PVBOXNETADPLINUXSTATS   pStats = per_cpu_ptr(pPriv->pStats, smp_processor_id());
 
     /* Update the stats. */
-    pPriv->Stats.tx_packets++;
-    pPriv->Stats.tx_bytes += pSkb->len;
+    u64_stats_update_begin(&pStats->Sync);
+    pStats->cTxPackets++;
+    pStats->cTxBytes += pSkb->len;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 18)
+    if (skb_is_gso(pSkb))
+    {
+        pStats->cTxGsoFrames++;
+        pStats->cTxGsoSegs += skb_shinfo(pSkb)->gso_segs;
+    }
+#endif
+    if (pSkb->ip_summed == CHECKSUM_PARTIAL)
+        pStats->cTxCsumOffload++;
+    u64_stats_update_end(&pStats->Sync);
     /* Update transmission time stamp. */
     pNetDev->trans_start = jiffies;
     /* Nothing else to do, just free the sk_buff. */
     dev_kfree_skb(pSkb);
-    return 0;
+    return NETDEV_TX_OK;
 }
 
+/**
+ * Sums up the per-CPU statistics of an adapter.
+ *
+ * @param   pPriv           The adapter's private data.
+ * @param   pSum            Where to return the totals.  The Sync member is
+ *                          not used.
+ */
+static void vboxNetAdpLinuxSumStats(PVBOXNETADPPRIV pPriv, PVBOXNETADPLINUXSTATS pSum)
+{
+    int iCpu;
+
+    memset(pSum, 0, sizeof(*pSum));
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETADPLINUXSTATS pStats = per_cpu_ptr(pPriv->pStats, iCpu);
+        VBOXNETADPLINUXSTATS  Snap;
+        unsigned              uSeq;
+
+        do
+        {
+            uSeq = u64_stats_fetch_begin(&pStats->Sync);
+            Snap.cTxPackets     = pStats->cTxPackets;
+            Snap.cTxBytes       = pStats->cTxBytes;
+            Snap.cTxGsoFrames   = pStats->cTxGsoFrames;
+            Snap.cTxGsoSegs     = pStats->cTxGsoSegs;
+            Snap.cTxCsumOffload = pStats->cTxCsumOffload;
+        } while (u64_stats_fetch_retry(&pStats->Sync, uSeq));
+
+        pSum->cTxPackets     += Snap.cTxPackets;
+        pSum->cTxBytes       += Snap.cTxBytes;
+        pSum->cTxGsoFrames   += Snap.cTxGsoFrames;
+        pSum->cTxGsoSegs     += Snap.cTxGsoSegs;
+        pSum->cTxCsumOffload += Snap.cTxCsumOffload;
+    }
+}
+
+#ifdef VBOXNETADP_WITH_STATS64
+static struct rtnl_link_stats64 *vboxNetAdpLinuxGetStats64(struct net_device *pNetDev, struct rtnl_link_stats64 *pLinkStats)
+{
+    VBOXNETADPLINUXSTATS Sum;
+
+    vboxNetAdpLinuxSumStats(netdev_priv(pNetDev), &Sum);
+    pLinkStats->tx_packets = Sum.cTxPackets;
+    pLinkStats->tx_bytes   = Sum.cTxBytes;
+    return pLinkStats;
+}
+#else  /* !VBOXNETADP_WITH_STATS64 */
 struct net_device_stats *vboxNetAdpLinuxGetStats(struct net_device *pNetDev)
 {
-    PVBOXNETADPPRIV pPriv = netdev_priv(pNetDev);
+    PVBOXNETADPPRIV      pPriv = netdev_priv(pNetDev);
+    VBOXNETADPLINUXSTATS Sum;
+
+    vboxNetAdpLinuxSumStats(pPriv, &Sum);
+    pPriv->Stats.tx_packets = Sum.cTxPackets;
+    pPriv->Stats.tx_bytes   = Sum.cTxBytes;
     return &pPriv->Stats;
 }
+#endif /* !VBOXNETADP_WITH_STATS64 */
+
+#ifdef VBOXNETADP_WITH_STATS64
+/** The names of the counters reported by vboxNetAdpLinuxGetEthtoolStats,
+ *  in that order. */
+static const char g_aszVBoxNetAdpLinuxStatNames[][ETH_GSTRING_LEN] =
+{
+    "tx_gso_frames",
+    "tx_gso_segments",
+    "tx_csum_offload"
+};
+
+static int vboxNetAdpLinuxGetSsetCount(struct net_device *pNetDev, int iSet)
+{
+    NOREF(pNetDev);
+    return iSet == ETH_SS_STATS ? (int)RT_ELEMENTS(g_aszVBoxNetAdpLinuxStatNames) : -EOPNOTSUPP;
+}
+
+static void vboxNetAdpLinuxGetStrings(struct net_device *pNetDev, u32 uSet, u8 *pbData)
+{
+    NOREF(pNetDev);
+    if (uSet == ETH_SS_STATS)
+        memcpy(pbData, g_aszVBoxNetAdpLinuxStatNames, sizeof(g_aszVBoxNetAdpLinuxStatNames));
+}
+
+/**
+ * Reports the offload counters, which struct rtnl_link_stats64 has no room
+ * for, to 'ethtool -S'.
+ */
+static void vboxNetAdpLinuxGetEthtoolStats(struct net_device *pNetDev, struct ethtool_stats *pEthStats, u64 *pau64Data)
+{
+    VBOXNETADPLINUXSTATS Sum;
+    NOREF(pEthStats);
+
+    vboxNetAdpLinuxSumStats(netdev_priv(pNetDev), &Sum);
+    pau64Data[0] = Sum.cTxGsoFrames;
+    pau64Data[1] = Sum.cTxGsoSegs;
+    pau64Data[2] = Sum.cTxCsumOffload;
+}
+
+static const struct ethtool_ops vboxNetAdpEthtoolOps = {
+    .get_link               = ethtool_op_get_link,
+    .get_sset_count         = vboxNetAdpLinuxGetSsetCount,
+    .get_strings            = vboxNetAdpLinuxGetStrings,
+    .get_ethtool_stats      = vboxNetAdpLinuxGetEthtoolStats
+};
+#endif /* VBOXNETADP_WITH_STATS64 */
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 29)
 static const struct net_device_ops vboxNetAdpNetdevOps = {
     .ndo_open               = vboxNetAdpLinuxOpen,
     .ndo_stop               = vboxNetAdpLinuxStop,
     .ndo_start_xmit         = vboxNetAdpLinuxXmit,
+# ifdef VBOXNETADP_WITH_STATS64
+    .ndo_get_stats64        = vboxNetAdpLinuxGetStats64
+# else
     .ndo_get_stats          = vboxNetAdpLinuxGetStats
+# endif
 };
 #endif
 
@@ -168,6 +394,22 @@ static void vboxNetAdpNetDevInit(struct net_device *pNetDev)
     pNetDev->hard_start_xmit = vboxNetAdpLinuxXmit;
     pNetDev->get_stats = vboxNetAdpLinuxGetStats;
 #endif /* LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 29) */
+#ifdef VBOXNETADP_WITH_STATS64
+    pNetDev->ethtool_ops = &vboxNetAdpEthtoolOps;
+#endif
+
+    /*
+     * Advertise the offloads so the host doesn't segment and checksum what
+     * vboxnetflt can pass on as it is.  LLTX as there is nothing to lock.
+     */
+    if (host_offload)
+    {
+        pNetDev->features |= VBOXNETADP_LINUX_OFFLOADS;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 39)
+        pNetDev->hw_features |= VBOXNETADP_LINUX_OFFLOADS;
+#endif
+    }
+    pNetDev->features |= NETIF_F_LLTX;
 
     pPriv = netdev_priv(pNetDev);
     memset(pPriv, 0, sizeof(*pPriv));
@@ -178,22 +420,39 @@ int vboxNetAdpOsCreate(PVBOXNETADP pThis, PCRTMAC pMACAddress)
 {
     int rc = VINF_SUCCESS;
     struct net_device *pNetDev;
+    unsigned cQueues = num_queues ? num_queues : num_online_cpus();
 
-    /* No need for private data. */
-    pNetDev = alloc_netdev(sizeof(VBOXNETADPPRIV), VBOXNETADP_LINUX_NAME, vboxNetAdpNetDevInit);
+    /*
+     * One queue per CPU by default, so host threads sending over the
+     * adapter don't serialize on a single qdisc lock.  vboxnetflt picks the
+     * frames up on the sending CPU and queues them on the same CPU, so this
+     * keeps a flow on one CPU all the way to the internal network.
+     */
+    cQueues = RT_MIN(RT_MAX(cQueues, 1), VBOXNETADP_LINUX_MAX_QUEUES);
+    pNetDev = VBOX_ALLOC_NETDEV_MQS(sizeof(VBOXNETADPPRIV), VBOXNETADP_LINUX_NAME, vboxNetAdpNetDevInit, cQueues);
     if (pNetDev)
     {
-        int err;
+        PVBOXNETADPPRIV pPriv = netdev_priv(pNetDev);
+        int err = -ENOMEM;
 
-        memcpy(pNetDev->dev_addr, pMACAddress, ETH_ALEN);
-        Log2(("vboxNetAdpOsCreate: pNetDev->dev_addr = %.6Rhxd\n", pNetDev->dev_addr));
-        err = register_netdev(pNetDev);
-        if (!err)
+        pPriv->pStats = alloc_percpu(VBOXNETADPLINUXSTATS);
+        if (pPriv->pStats)
         {
-            strncpy(pThis->szName, pNetDev->name, VBOXNETADP_MAX_NAME_LEN);
-            pThis->u.s.pNetDev = pNetDev;
-            Log2(("vboxNetAdpOsCreate: pThis=%p pThis->szName = %p\n", pThis, pThis->szName));
-            return VINF_SUCCESS;
+            int iCpu;
+            for_each_possible_cpu(iCpu)
+                u64_stats_init(&per_cpu_ptr(pPriv->pStats, iCpu)->Sync);
+
+            memcpy(pNetDev->dev_addr, pMACAddress, ETH_ALEN);
+            Log2(("vboxNetAdpOsCreate: pNetDev->dev_addr = %.6Rhxd\n", pNetDev->dev_addr));
+            err = register_netdev(pNetDev);
+            if (!err)
+            {
+                strncpy(pThis->szName, pNetDev->name, VBOXNETADP_MAX_NAME_LEN);
+                pThis->u.s.pNetDev = pNetDev;
+                Log2(("vboxNetAdpOsCreate: pThis=%p pThis->szName = %p\n", pThis, pThis->szName));
+                return VINF_SUCCESS;
+            }
+            free_percpu(pPriv->pStats);
         }
         free_netdev(pNetDev);
         rc = RTErrConvertFromErrno(err);
@@ -208,6 +467,7 @@ void vboxNetAdpOsDestroy(PVBOXNETADP pThis)
 
     pThis->u.s.pNetDev = NULL;
     unregister_netdev(pNetDev);
+    free_percpu(((PVBOXNETADPPRIV)netdev_priv(pNetDev))->pStats);
     free_netdev(pNetDev);
 }
 
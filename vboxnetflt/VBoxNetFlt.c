@@ -251,6 +251,7 @@
 #include "VBoxNetFltInternal.h"
 
 #include <VBox/sup.h>
+#include <VBox/intnetinline.h>
 #include <VBox/log.h>
 #include <VBox/err.h>
 #include <iprt/assert.h>
@@ -309,14 +310,30 @@ DECLINLINE(VBOXNETFTLINSSTATE) vboxNetFltGetState(PVBOXNETFLTINS pThis)
  */
 static PVBOXNETFLTINS vboxNetFltFindInstanceLocked(PVBOXNETFLTGLOBALS pGlobals, const char *pszName)
 {
-    PVBOXNETFLTINS pCur;
-    for (pCur = pGlobals->pInstanceHead; pCur; pCur = pCur->pNext)
+    PVBOXNETFLTINS pCur = pGlobals->apInstanceHash[IntNetNameHash(pszName) & (VBOXNETFLT_NAME_HASH_SIZE - 1)];
+    for (; pCur; pCur = pCur->pNext)
         if (!strcmp(pszName, pCur->szName))
             return pCur;
     return NULL;
 }
 
 
+/**
+ * Links an instance into the name hash table, the caller does the locking
+ * and has checked for duplicates.
+ *
+ * @param   pGlobals        The globals.
+ * @param   pToLink         The instance to link.
+ */
+static void vboxNetFltLinkLocked(PVBOXNETFLTGLOBALS pGlobals, PVBOXNETFLTINS pToLink)
+{
+    PVBOXNETFLTINS *ppHead = &pGlobals->apInstanceHash[IntNetNameHash(pToLink->szName) & (VBOXNETFLT_NAME_HASH_SIZE - 1)];
+    pToLink->pNext = *ppHead;
+    *ppHead = pToLink;
+    pGlobals->cInstances++;
+}
+
+
 /**
  * Finds a instance by its name, will request the mutex.
  *
@@ -342,25 +359,22 @@ DECLHIDDEN(PVBOXNETFLTINS) vboxNetFltFindInstance(PVBOXNETFLTGLOBALS pGlobals, c
 
 
 /**
- * Unlinks an instance from the chain.
+ * Unlinks an instance from the name hash table.
  *
  * @param   pGlobals        The globals.
  * @param   pToUnlink       The instance to unlink.
  */
 static void vboxNetFltUnlinkLocked(PVBOXNETFLTGLOBALS pGlobals, PVBOXNETFLTINS pToUnlink)
 {
-    if (pGlobals->pInstanceHead == pToUnlink)
-        pGlobals->pInstanceHead = pToUnlink->pNext;
-    else
+    PVBOXNETFLTINS *ppCur = &pGlobals->apInstanceHash[IntNetNameHash(pToUnlink->szName) & (VBOXNETFLT_NAME_HASH_SIZE - 1)];
+    while (*ppCur && *ppCur != pToUnlink)
+        ppCur = &(*ppCur)->pNext;
+    Assert(*ppCur);
+    if (*ppCur)
     {
-        PVBOXNETFLTINS pCur;
-        for (pCur = pGlobals->pInstanceHead; pCur; pCur = pCur->pNext)
-            if (pCur->pNext == pToUnlink)
-            {
-                pCur->pNext = pToUnlink->pNext;
-                break;
-            }
-        Assert(pCur);
+        *ppCur = pToUnlink->pNext;
+        Assert(pGlobals->cInstances > 0);
+        pGlobals->cInstances--;
     }
     pToUnlink->pNext = NULL;
 }
@@ -1034,8 +1048,7 @@ static int vboxNetFltNewInstance(PVBOXNETFLTGLOBALS pGlobals, const char *pszNam
                 {
                     if (!vboxNetFltFindInstanceLocked(pGlobals, pszName))
                     {
-                        pNew->pNext = pGlobals->pInstanceHead;
-                        pGlobals->pInstanceHead = pNew;
+                        vboxNetFltLinkLocked(pGlobals, pNew);
                         RTSemFastMutexRelease(pGlobals->hFastMtx);
 
                         /*
@@ -1370,7 +1383,7 @@ static DECLCALLBACK(void *) vboxNetFltQueryFactoryInterface(PCSUPDRVFACTORY pSup
 DECLHIDDEN(bool) vboxNetFltCanUnload(PVBOXNETFLTGLOBALS pGlobals)
 {
     int rc = RTSemFastMutexRequest(pGlobals->hFastMtx);
-    bool fRc = !pGlobals->pInstanceHead
+    bool fRc = !pGlobals->cInstances
             && pGlobals->cFactoryRefs <= 0;
     RTSemFastMutexRelease(pGlobals->hFastMtx);
     AssertRC(rc);
@@ -1497,7 +1510,8 @@ DECLHIDDEN(int) vboxNetFltInitGlobals(PVBOXNETFLTGLOBALS pGlobals)
     int rc = RTSemFastMutexCreate(&pGlobals->hFastMtx);
     if (RT_SUCCESS(rc))
     {
-        pGlobals->pInstanceHead = NULL;
+        memset(pGlobals->apInstanceHash, 0, sizeof(pGlobals->apInstanceHash));
+        pGlobals->cInstances = 0;
 
         pGlobals->TrunkFactory.pfnRelease = vboxNetFltFactoryRelease;
         pGlobals->TrunkFactory.pfnCreateAndConnect = vboxNetFltFactoryCreateAndConnect;
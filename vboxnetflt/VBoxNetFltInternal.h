@@ -29,6 +29,9 @@ RT_C_DECLS_BEGIN
 /** Pointer to the globals. */
 typedef struct VBOXNETFLTGLOBALS *PVBOXNETFLTGLOBALS;
 
+/** The number of buckets in the instance name hash table (power of two). */
+#define VBOXNETFLT_NAME_HASH_SIZE   256
+
 
 /**
  * The state of a filter driver instance.
@@ -88,7 +91,8 @@ typedef enum VBOXNETFTLINSSTATE
  */
 typedef struct VBOXNETFLTINS
 {
-    /** Pointer to the next interface in the list. (VBOXNETFLTGLOBAL::pInstanceHead) */
+    /** Pointer to the next interface in the same name hash bucket.
+     * (VBOXNETFLTGLOBALS::apInstanceHash) */
     struct VBOXNETFLTINS *pNext;
     /** Our RJ-45 port.
      * This is what the internal network plugs into. */
@@ -166,12 +170,25 @@ typedef struct VBOXNETFLTINS
             bool volatile fRegistered;
             /** The MAC address of the interface. */
             RTMAC MacAddr;
-            struct notifier_block Notifier;
+            /** Node in the interface name hash table, linked (under the RTNL) for
+             * as long as the instance exists so the notifier finds it. */
+            struct hlist_node     NameNode;
+            /** Node in the ifindex hash table, linked (under the RTNL) while the
+             * instance is attached to the device. */
+            struct hlist_node     IfIndexNode;
+            /** The ifindex of the device we're attached to. */
+            int                   iIfIndex;
             struct packet_type    PacketType;
-#  ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-            struct sk_buff_head   XmitQueue;
-            struct work_struct    XmitTask;
-#  endif
+            /** Per-CPU receive queues feeding the internal network (alloc_percpu).
+             * Frames are queued and forwarded on the CPU that received them. */
+            struct VBOXNETFLTLINUXRXQ *pRxQueues;
+            /** Per-CPU datapath statistics (VBOXNETFLTLINUXSTATS, alloc_percpu), NULL
+             * unless selected by the datapath_stats module parameter. */
+            struct VBOXNETFLTLINUXSTATS *pStats;
+            /** The number of GSO frames passed on to the NIC as they are. */
+            uint64_t volatile     cGsoOffloaded;
+            /** The number of GSO frames we had to segment in software. */
+            uint64_t volatile     cGsoSwSegmented;
             /** @} */
 # elif defined(RT_OS_SOLARIS)
             /** @name Solaris instance data.
@@ -296,10 +313,13 @@ AssertCompile(RT_SIZEOFMEMB(VBOXNETFLTINS, u.s) <= RT_SIZEOFMEMB(VBOXNETFLTINS,
  */
 typedef struct VBOXNETFLTGLOBALS
 {
-    /** Mutex protecting the list of instances and state changes. */
+    /** Mutex protecting the instance hash table and state changes. */
     RTSEMFASTMUTEX hFastMtx;
-    /** Pointer to a list of instance data. */
-    PVBOXNETFLTINS pInstanceHead;
+    /** The instances hashed by name (IntNetNameHash), chained thru
+     * VBOXNETFLTINS::pNext. */
+    PVBOXNETFLTINS apInstanceHash[VBOXNETFLT_NAME_HASH_SIZE];
+    /** The number of instances in apInstanceHash. */
+    uint32_t cInstances;
 
     /** The INTNET trunk network interface factory. */
     INTNETTRUNKFACTORY TrunkFactory;
@@ -19,7 +19,6 @@
 *   Header Files                                                               *
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_NET_FLT_DRV
-#define VBOXNETFLT_LINUX_NO_XMIT_QUEUE
 #include "the-linux-kernel.h"
 #include "version-generated.h"
 #include "product-generated.h"
@@ -28,6 +27,13 @@
 #include <linux/rtnetlink.h>
 #include <linux/miscdevice.h>
 #include <linux/ip.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 26)
+# include <linux/proc_fs.h>
+# include <linux/seq_file.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 36)
+# include <linux/u64_stats_sync.h>
+#endif
 
 #include <VBox/log.h>
 #include <VBox/err.h>
@@ -54,10 +60,71 @@
 /*******************************************************************************
 *   Defined Constants And Macros                                               *
 *******************************************************************************/
-#define VBOX_FLT_NB_TO_INST(pNB)    RT_FROM_MEMBER(pNB, VBOXNETFLTINS, u.s.Notifier)
+#define VBOX_FLT_NAME_TO_INST(pNode)    RT_FROM_MEMBER(pNode, VBOXNETFLTINS, u.s.NameNode)
+#define VBOX_FLT_IFINDEX_TO_INST(pNode) RT_FROM_MEMBER(pNode, VBOXNETFLTINS, u.s.IfIndexNode)
 #define VBOX_FLT_PT_TO_INST(pPT)    RT_FROM_MEMBER(pPT, VBOXNETFLTINS, u.s.PacketType)
-#ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-# define VBOX_FLT_XT_TO_INST(pXT)   RT_FROM_MEMBER(pXT, VBOXNETFLTINS, u.s.XmitTask)
+
+/** The max number of frames a receive queue poll forwards before giving the
+ *  CPU back to the other softirqs. */
+#define VBOXNETFLT_LINUX_RXQ_BUDGET         64
+/** The default max number of frames waiting in one per-CPU receive queue,
+ *  see netdev_max_backlog and the rxq_max_depth module parameter. */
+#define VBOXNETFLT_LINUX_RXQ_MAX_DEPTH      1000
+/** The default number of milliseconds frames may wait in a receive queue of
+ *  an inactive instance, see the rxq_inactive_drain_ms module parameter. */
+#define VBOXNETFLT_LINUX_RXQ_DRAIN_MS       2000
+/** The enqueue timestamp (RTTimeSystemNanoTS) of a socket buffer in a
+ *  receive queue. */
+#define VBOXNETFLT_SKB_RXQ_TS(skb)          (*(uint64_t *)&(skb)->cb[0])
+
+/** @name Receive path policies (rx_direct module parameter).
+ * @{ */
+/** Queue all frames. */
+#define VBOXNETFLT_RX_DIRECT_NEVER          0
+/** Forward linear non-GSO frames of an active trunk directly when in softirq
+ *  context, queue the rest. */
+#define VBOXNETFLT_RX_DIRECT_LINEAR         1
+/** Forward all frames of an active trunk directly. */
+#define VBOXNETFLT_RX_DIRECT_ALWAYS         2
+/** @} */
+
+/** The number of log2 buckets in a histogram, bucket N counts the samples
+ *  in [2^N, 2^(N+1)), i.e. nanoseconds (~2 seconds and up in the last) or
+ *  frames. */
+#define VBOXNETFLT_LINUX_HIST_BUCKETS       32
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 26)
+/** This enables or disables the /proc/net/vboxnetflt/<ifname> datapath
+ *  statistics, see the datapath_stats module parameter. */
+# define VBOXNETFLT_WITH_DATAPATH_STATS     1
+#endif
+
+/** The number of buckets in the ifindex hash table (power of two). */
+#define VBOXNETFLT_LINUX_IFINDEX_HASH_SIZE  256
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24)
+# define VBOX_DEV_GET_BY_NAME(pszName)      __dev_get_by_name(&init_net, pszName)
+#else
+# define VBOX_DEV_GET_BY_NAME(pszName)      __dev_get_by_name(pszName)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 36)
+struct u64_stats_sync { int iDummy; };
+# define u64_stats_update_begin(pSync)      do { } while (0)
+# define u64_stats_update_end(pSync)        do { } while (0)
+# define u64_stats_fetch_begin(pSync)       0
+# define u64_stats_fetch_retry(pSync, uSeq) false
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+# define u64_stats_init(pSync)              do { } while (0)
+#endif
+
+#ifndef for_each_possible_cpu
+# define for_each_possible_cpu(cpu)         for_each_cpu(cpu)
+#endif
+
+#ifndef RCU_INIT_POINTER
+# define RCU_INIT_POINTER(p, v)             rcu_assign_pointer(p, v)
 #endif
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 22)
@@ -87,10 +154,19 @@
 # define NET_IP_ALIGN 2
 #endif
 
-#if 0
 /** Create scatter / gather segments for fragments. When not used, we will
  *  linearize the socket buffer before creating the internal networking SG. */
-# define VBOXNETFLT_SG_SUPPORT 1
+#define VBOXNETFLT_SG_SUPPORT 1
+
+/** The max number of INTNETSEG segments we put on the stack for a received
+ *  socket buffer: the head, its page fragments and one head plus page
+ *  fragments for a frag_list member.  Anything larger gets linearized. */
+#define VBOXNETFLT_LINUX_MAX_SEGS           (2 * (MAX_SKB_FRAGS + 1))
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 18)
+# define VBOX_SKB_LINEARIZE(skb)            skb_linearize(skb)
+#else
+# define VBOX_SKB_LINEARIZE(skb)            skb_linearize(skb, GFP_ATOMIC)
 #endif
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 18)
@@ -101,11 +177,11 @@
  *  network and to the host.  */
 # define VBOXNETFLT_WITH_GSO_XMIT_HOST      1
 
-# if 0 /** @todo This is currently disable because it causes performance loss of 5-10%.  */
 /** This enables or disables the transmitting of GSO frame from the internal
- *  network and to the wire. */
-#  define VBOXNETFLT_WITH_GSO_XMIT_WIRE     1
-# endif
+ *  network and to the wire.  Whether GSO frames are actually offloaded to the
+ *  NIC is decided at runtime by the gso_xmit_wire module parameter, as doing
+ *  it unconditionally has been seen to cost 5-10% with some NICs. */
+# define VBOXNETFLT_WITH_GSO_XMIT_WIRE      1
 
 /** This enables or disables the forwarding/flooding of GSO frame from the host
  *  to the internal network.  */
@@ -113,6 +189,12 @@
 
 #endif
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 20)
+/** This enables or disables checksumming frames for the host while copying
+ *  them, handing them over as CHECKSUM_COMPLETE. */
+# define VBOXNETFLT_WITH_HOST_CSUM_COMPLETE 1
+#endif
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 29)
 /** This enables or disables handling of GSO frames coming from the wire (GRO). */
 # define VBOXNETFLT_WITH_GRO                1
@@ -126,12 +208,133 @@
 # endif
 #endif
 
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Per-CPU datapath counters of a net filter instance.
+ *
+ * Unlike VBOXNETFLTLINUXSTATS these are always kept.  Each CPU only writes its
+ * own copy, from softirq context or with bottom halves disabled, and the
+ * u64_stats_sync gives readers consistent 64-bit values on 32-bit hosts.
+ */
+typedef struct VBOXNETFLTLINUXCOUNTERS
+{
+    /** The number of frames forwarded to the internal network. */
+    uint64_t                cRxPackets;
+    /** The number of bytes forwarded to the internal network. */
+    uint64_t                cRxBytes;
+    /** The number of received frames dropped by the receive queues. */
+    uint64_t                cRxDrops;
+    /** The number of frames sent from the internal network to the wire/host. */
+    uint64_t                cTxPackets;
+    /** The number of bytes sent from the internal network to the wire/host. */
+    uint64_t                cTxBytes;
+    /** The number of frames from the internal network we failed to send. */
+    uint64_t                cTxDrops;
+    /** The number of GSO frames, both directions. */
+    uint64_t                cGsoFrames;
+    /** The number of frames with offloaded checksums (CHECKSUM_PARTIAL), both
+     *  directions. */
+    uint64_t                cCsumOffload;
+    /** Writer sequence for the 64-bit counters. */
+    struct u64_stats_sync   Sync;
+} VBOXNETFLTLINUXCOUNTERS;
+/** Pointer to per-CPU datapath counters. */
+typedef VBOXNETFLTLINUXCOUNTERS *PVBOXNETFLTLINUXCOUNTERS;
+
+/**
+ * Per-CPU receive queue of a net filter instance.
+ *
+ * vboxNetFltLinuxPacketHandler appends frames to the queue of the CPU it runs
+ * on and schedules the tasklet, which then forwards them to the internal
+ * network in bursts of VBOXNETFLT_LINUX_RXQ_BUDGET on the same CPU.
+ */
+typedef struct VBOXNETFLTLINUXRXQ
+{
+    /** The queued socket buffers. */
+    struct sk_buff_head     Queue;
+    /** The tasklet polling the queue. */
+    struct tasklet_struct   Tasklet;
+    /** Timer rescheduling the tasklet when frames are left waiting for the
+     *  drain age while the instance is inactive.  Always armed on the CPU
+     *  owning the queue. */
+    struct timer_list       Timer;
+    /** Set while vboxNetFltLinuxRxQueuesPurge is stopping the tasklet and
+     *  the timer so they do not rearm each other. */
+    bool volatile           fStopping;
+    /** The instance this queue belongs to. */
+    PVBOXNETFLTINS          pThis;
+    /** The number of frames dropped because the queue was full. */
+    uint64_t volatile       cDrops;
+    /** The number of frames dropped because they aged while the instance
+     * was inactive. */
+    uint64_t volatile       cAgeDrops;
+    /** The deepest the queue has been (high watermark). */
+    uint32_t volatile       cMaxDepth;
+    /** The longest a frame has waited in the queue, in milliseconds. */
+    uint32_t volatile       cMsMaxAge;
+    /** The datapath counters of this CPU.  They live here as this is the
+     *  per-CPU block every instance has. */
+    VBOXNETFLTLINUXCOUNTERS Counters;
+} VBOXNETFLTLINUXRXQ;
+/** Pointer to a per-CPU receive queue. */
+typedef VBOXNETFLTLINUXRXQ *PVBOXNETFLTLINUXRXQ;
+
+/**
+ * Receive queue statistics of a net filter instance, summed up over all CPUs.
+ */
+typedef struct VBOXNETFLTLINUXRXQSTATS
+{
+    /** The number of frames currently queued. */
+    uint32_t                cQueued;
+    /** The high watermark of the deepest queue. */
+    uint32_t                cMaxDepth;
+    /** The longest a frame has waited in a queue, in milliseconds. */
+    uint32_t                cMsMaxAge;
+    /** The number of frames dropped because a queue was full. */
+    uint64_t                cDrops;
+    /** The number of frames dropped by the inactive drain policy. */
+    uint64_t                cAgeDrops;
+} VBOXNETFLTLINUXRXQSTATS;
+/** Pointer to receive queue statistics. */
+typedef VBOXNETFLTLINUXRXQSTATS *PVBOXNETFLTLINUXRXQSTATS;
+
+/**
+ * Per-CPU datapath statistics of a net filter instance.
+ *
+ * Only allocated for the instances selected by the datapath_stats module
+ * parameter, the datapath checks for a NULL pointer and skips all time
+ * stamping and counting otherwise.  Each CPU only updates its own copy, so
+ * there is no locking or atomics; readers sum them up and may see slightly
+ * stale values.
+ */
+typedef struct VBOXNETFLTLINUXSTATS
+{
+    /** Latency histogram of the frames forwarded directly by the packet
+     *  handler (entry to pfnRecv return). */
+    uint64_t                acDirectLatency[VBOXNETFLT_LINUX_HIST_BUCKETS];
+    /** Latency histogram of the queued frames (enqueue to pfnRecv return). */
+    uint64_t                acQueuedLatency[VBOXNETFLT_LINUX_HIST_BUCKETS];
+    /** Latency histogram of the transmit calls (entry to return of
+     *  vboxNetFltPortOsXmit). */
+    uint64_t                acXmitLatency[VBOXNETFLT_LINUX_HIST_BUCKETS];
+    /** Histogram of the receive queue depth seen by each enqueued frame. */
+    uint64_t                acQueueDepth[VBOXNETFLT_LINUX_HIST_BUCKETS];
+} VBOXNETFLTLINUXSTATS;
+/** Pointer to per-CPU datapath statistics. */
+typedef VBOXNETFLTLINUXSTATS *PVBOXNETFLTLINUXSTATS;
+
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
 static int      VBoxNetFltLinuxInit(void);
 static void     VBoxNetFltLinuxUnload(void);
 static void     vboxNetFltLinuxForwardToIntNet(PVBOXNETFLTINS pThis, struct sk_buff *pBuf);
+static int      vboxNetFltLinuxNotifierCallback(struct notifier_block *self, unsigned long ulEventType, void *ptr);
+static void     vboxNetFltLinuxRxQueueAdd(PVBOXNETFLTINS pThis, struct sk_buff *pBuf);
+static bool     vboxNetFltLinuxRxDirect(PVBOXNETFLTINS pThis, struct sk_buff *pBuf);
 
 
 /*******************************************************************************
@@ -142,6 +345,39 @@ static void     vboxNetFltLinuxForwardToIntNet(PVBOXNETFLTINS pThis, struct sk_b
  */
 static VBOXNETFLTGLOBALS g_VBoxNetFltGlobals;
 
+/** The instances hashed by interface name (IntNetNameHash).
+ * Updated under the RTNL, looked up with RCU. */
+static struct hlist_head g_aNameHash[VBOXNETFLT_NAME_HASH_SIZE];
+/** The attached instances hashed by the ifindex of their device.
+ * Updated under the RTNL, looked up with RCU. */
+static struct hlist_head g_aIfIndexHash[VBOXNETFLT_LINUX_IFINDEX_HASH_SIZE];
+/** The netdevice notifier shared by all instances. */
+static struct notifier_block g_Notifier;
+
+#ifdef VBOXNETFLT_WITH_GSO_XMIT_WIRE
+/** Whether to negotiate GSO offloading with the NIC and pass GSO frames from
+ *  the internal network on to it (1), or let the switch segment them (0). */
+static int gso_xmit_wire = 0;
+#endif
+
+/** The max number of frames in one per-CPU receive queue, frames arriving
+ *  at a full queue are dropped (tail-drop). */
+static unsigned rxq_max_depth = VBOXNETFLT_LINUX_RXQ_MAX_DEPTH;
+/** The number of milliseconds frames may wait in the receive queue of an
+ *  inactive (e.g. paused) instance before being dropped.  0 drops them
+ *  immediately. */
+static unsigned rxq_inactive_drain_ms = VBOXNETFLT_LINUX_RXQ_DRAIN_MS;
+/** The receive path policy, VBOXNETFLT_RX_DIRECT_XXX. */
+static int rx_direct = VBOXNETFLT_RX_DIRECT_LINEAR;
+
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+/** Comma separated list of the interfaces to collect datapath statistics
+ *  for, "*" for all of them. */
+static char datapath_stats[256] = "";
+/** The /proc/net/vboxnetflt directory. */
+static struct proc_dir_entry *g_pProcDir = NULL;
+#endif
+
 module_init(VBoxNetFltLinuxInit);
 module_exit(VBoxNetFltLinuxUnload);
 
@@ -152,6 +388,21 @@ MODULE_LICENSE("GPL");
 MODULE_VERSION(VBOX_VERSION_STRING " (" RT_XSTR(INTNETTRUNKIFPORT_VERSION) ")");
 #endif
 
+#ifdef VBOXNETFLT_WITH_GSO_XMIT_WIRE
+module_param(gso_xmit_wire, int, 0644);
+MODULE_PARM_DESC(gso_xmit_wire, "offload GSO frames to the NIC when it supports TSO/UFO (applies from the next attach or feature change)");
+#endif
+module_param(rxq_max_depth, uint, 0644);
+MODULE_PARM_DESC(rxq_max_depth, "max number of frames in a per-CPU receive queue");
+module_param(rxq_inactive_drain_ms, uint, 0644);
+MODULE_PARM_DESC(rxq_inactive_drain_ms, "milliseconds frames are kept queued while the trunk is inactive");
+module_param(rx_direct, int, 0644);
+MODULE_PARM_DESC(rx_direct, "forward received frames directly: 0=never (queue all), 1=linear non-GSO frames in softirq, 2=always");
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+module_param_string(datapath_stats, datapath_stats, sizeof(datapath_stats), 0644);
+MODULE_PARM_DESC(datapath_stats, "interfaces (comma separated, * for all) collecting datapath statistics in /proc/net/vboxnetflt (applies when attaching)");
+#endif
+
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 12) && defined(LOG_ENABLED)
 unsigned dev_get_flags(const struct net_device *dev)
@@ -198,11 +449,28 @@ static int __init VBoxNetFltLinuxInit(void)
         rc = vboxNetFltInitGlobalsAndIdc(&g_VBoxNetFltGlobals);
         if (RT_SUCCESS(rc))
         {
-            LogRel(("VBoxNetFlt: Successfully started.\n"));
-            return 0;
-        }
+            /*
+             * Listen for netdevice events, the notifier dispatches them to
+             * the instances using the hash tables.
+             */
+            g_Notifier.notifier_call = vboxNetFltLinuxNotifierCallback;
+            rc = register_netdevice_notifier(&g_Notifier);
+            if (!rc)
+            {
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+                /* Not fatal, the instances just go without /proc entries. */
+                g_pProcDir = proc_mkdir("vboxnetflt", init_net.proc_net);
+#endif
+                LogRel(("VBoxNetFlt: Successfully started.\n"));
+                return 0;
+            }
 
-        LogRel(("VBoxNetFlt: failed to initialize device extension (rc=%d)\n", rc));
+            LogRel(("VBoxNetFlt: failed to register the netdevice notifier (err=%d)\n", rc));
+            rc = RTErrConvertFromErrno(-rc);
+            vboxNetFltTryDeleteIdcAndGlobals(&g_VBoxNetFltGlobals);
+        }
+        else
+            LogRel(("VBoxNetFlt: failed to initialize device extension (rc=%d)\n", rc));
         RTR0Term();
     }
     else
@@ -230,6 +498,16 @@ static void __exit VBoxNetFltLinuxUnload(void)
     rc = vboxNetFltTryDeleteIdcAndGlobals(&g_VBoxNetFltGlobals);
     AssertRC(rc); NOREF(rc);
 
+    unregister_netdevice_notifier(&g_Notifier);
+
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+    if (g_pProcDir)
+    {
+        remove_proc_entry("vboxnetflt", init_net.proc_net);
+        g_pProcDir = NULL;
+    }
+#endif
+
     RTR0Term();
 
     memset(&g_VBoxNetFltGlobals, 0, sizeof(g_VBoxNetFltGlobals));
@@ -411,38 +689,27 @@ static void vboxNetFltLinuxUnhookDev(PVBOXNETFLTINS pThis, struct net_device *pD
 
 
 /**
- * Reads and retains the host interface handle.
+ * Reads the host interface handle for short term use (e.g. transmitting a
+ * frame), entering an RCU read side section if attached.
+ *
+ * This is cheap enough for the per-frame paths: no spinlock and no device
+ * reference counting.  The price is that the caller must not sleep until
+ * calling vboxNetFltLinuxReleaseNetDev.  vboxNetFltLinuxUnregisterDevice
+ * clears u.s.pDev before dev_remove_pack waits for a grace period and the
+ * device reference is dropped, so the handle stays valid until then.
  *
  * @returns The handle, NULL if detached.
- * @param   pThis
+ * @param   pThis           The instance.
  */
 DECLINLINE(struct net_device *) vboxNetFltLinuxRetainNetDev(PVBOXNETFLTINS pThis)
 {
-#if 0
-    RTSPINLOCKTMP Tmp = RTSPINLOCKTMP_INITIALIZER;
-    struct net_device *pDev = NULL;
-
-    Log(("vboxNetFltLinuxRetainNetDev\n"));
-    /*
-     * Be careful here to avoid problems racing the detached callback.
-     */
-    RTSpinlockAcquire(pThis->hSpinlock, &Tmp);
-    if (!ASMAtomicUoReadBool(&pThis->fDisconnectedFromHost))
-    {
-        pDev = (struct net_device *)ASMAtomicUoReadPtr((void * volatile *)&pThis->u.s.pDev);
-        if (pDev)
-        {
-            dev_hold(pDev);
-            Log(("vboxNetFltLinuxRetainNetDev: Device %p(%s) retained. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
-        }
-    }
-    RTSpinlockRelease(pThis->hSpinlock, &Tmp);
+    struct net_device *pDev;
 
-    Log(("vboxNetFltLinuxRetainNetDev - done\n"));
+    rcu_read_lock();
+    pDev = rcu_dereference(*(struct net_device **)&pThis->u.s.pDev);
+    if (!pDev)
+        rcu_read_unlock();
     return pDev;
-#else
-    return (struct net_device *)ASMAtomicUoReadPtr((void * volatile *)&pThis->u.s.pDev);
-#endif
 }
 
 
@@ -456,16 +723,52 @@ DECLINLINE(struct net_device *) vboxNetFltLinuxRetainNetDev(PVBOXNETFLTINS pThis
  */
 DECLINLINE(void) vboxNetFltLinuxReleaseNetDev(PVBOXNETFLTINS pThis, struct net_device *pDev)
 {
-#if 0
-    Log(("vboxNetFltLinuxReleaseNetDev\n"));
+    NOREF(pThis);
+    if (pDev)
+        rcu_read_unlock();
+}
+
+
+/**
+ * Reads and references the host interface handle for long term use, i.e.
+ * when the caller may sleep.
+ *
+ * @returns The handle, NULL if detached.
+ * @param   pThis           The instance.
+ */
+static struct net_device *vboxNetFltLinuxHoldNetDev(PVBOXNETFLTINS pThis)
+{
+    struct net_device *pDev = vboxNetFltLinuxRetainNetDev(pThis);
+    if (pDev)
+    {
+        if (!ASMAtomicUoReadBool(&pThis->fDisconnectedFromHost))
+        {
+            dev_hold(pDev);
+            Log(("vboxNetFltLinuxHoldNetDev: Device %p(%s) retained.\n", pDev, pDev->name));
+            vboxNetFltLinuxReleaseNetDev(pThis, pDev);
+            return pDev;
+        }
+        vboxNetFltLinuxReleaseNetDev(pThis, pDev);
+    }
+    return NULL;
+}
+
+
+/**
+ * Releases a host interface handle referenced by vboxNetFltLinuxHoldNetDev.
+ *
+ * @param   pThis           The instance.
+ * @param   pDev            The vboxNetFltLinuxHoldNetDev return value, NULL
+ *                          is fine.
+ */
+static void vboxNetFltLinuxPutNetDev(PVBOXNETFLTINS pThis, struct net_device *pDev)
+{
     NOREF(pThis);
     if (pDev)
     {
+        Log(("vboxNetFltLinuxPutNetDev: Device %p(%s) released.\n", pDev, pDev->name));
         dev_put(pDev);
-        Log(("vboxNetFltLinuxReleaseNetDev: Device %p(%s) released. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
     }
-    Log(("vboxNetFltLinuxReleaseNetDev - done\n"));
-#endif
 }
 
 #define VBOXNETFLT_CB_TAG(skb) (0xA1C90000 | (skb->dev->ifindex & 0xFFFF))
@@ -484,6 +787,100 @@ DECLINLINE(bool) vboxNetFltLinuxSkBufIsOur(struct sk_buff *pBuf)
 }
 
 
+#ifdef VBOXNETFLT_WITH_GSO_XMIT_WIRE
+/**
+ * Works out which GSO types the NIC can do in hardware.
+ *
+ * Segmentation offloading is useless without scatter / gather and checksum
+ * offloading for the protocol, the kernel would segment in software anyway.
+ *
+ * @returns Mask of RT_BIT_32(PDMNETWORKGSOTYPE_XXX).
+ * @param   fFeatures       The NETIF_F_XXX features of the device.
+ */
+static uint32_t vboxNetFltLinuxGsoCapsFromFeatures(unsigned long fFeatures)
+{
+    uint32_t fGsoCaps = 0;
+
+    if (!gso_xmit_wire || !(fFeatures & NETIF_F_SG))
+        return 0;
+
+    if (   (fFeatures & NETIF_F_TSO)
+        && (fFeatures & (NETIF_F_IP_CSUM | NETIF_F_HW_CSUM)))
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_TCP);
+# ifdef NETIF_F_IPV6_CSUM
+    if (   (fFeatures & NETIF_F_TSO6)
+        && (fFeatures & (NETIF_F_IPV6_CSUM | NETIF_F_HW_CSUM)))
+# else
+    if (   (fFeatures & NETIF_F_TSO6)
+        && (fFeatures & NETIF_F_HW_CSUM))
+# endif
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_TCP);
+    /* IPv6 UFO needs a fragment ID (skb_shinfo()->ip6_frag_id) we have no
+       way of picking here, so only IPv4 UDP is offloaded. */
+    if (   (fFeatures & NETIF_F_UFO)
+        && (fFeatures & NETIF_F_HW_CSUM))
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_UDP);
+
+    return fGsoCaps;
+}
+
+/**
+ * Checks whether the NIC can take a GSO frame from the internal network as
+ * it is, i.e. without us segmenting it first.
+ *
+ * The features may have changed since we reported them to the switch, so
+ * this is checked for each frame.
+ *
+ * @returns true if the frame can be offloaded, false if it must be segmented.
+ * @param   pThis           The instance.
+ * @param   pDev            The device.
+ * @param   pSG             The (scatter/)gather list of the GSO frame.
+ */
+static bool vboxNetFltLinuxCanOffloadGso(PVBOXNETFLTINS pThis, struct net_device *pDev, PCINTNETSG pSG)
+{
+    NOREF(pThis);
+    if (!(vboxNetFltLinuxGsoCapsFromFeatures(pDev->features) & RT_BIT_32(pSG->GsoCtx.u8Type)))
+        return false;
+# if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 26)
+    if (pSG->cbTotal > pDev->gso_max_size)
+        return false;
+# endif
+    return true;
+}
+
+/**
+ * Segments a GSO socket buffer the NIC cannot offload and queues the
+ * segments for transmission.
+ *
+ * @returns 0 or negative errno.
+ * @param   pThis           The instance.
+ * @param   pBuf            The GSO socket buffer.  This is consumed.
+ * @param   pQueue          The queue to append the segments to.
+ */
+static int vboxNetFltLinuxSegmentForWire(PVBOXNETFLTINS pThis, struct sk_buff *pBuf, struct sk_buff_head *pQueue)
+{
+    struct sk_buff *pSegment;
+    struct sk_buff *pNext;
+
+    pSegment = skb_gso_segment(pBuf, 0 /*supported features*/);
+    dev_kfree_skb(pBuf);
+    if (IS_ERR(pSegment))
+    {
+        LogRel(("VBoxNetFlt: Failed to segment a packet (%d).\n", PTR_ERR(pSegment)));
+        return PTR_ERR(pSegment);
+    }
+
+    ASMAtomicIncU64(&pThis->u.s.cGsoSwSegmented);
+    for (; pSegment; pSegment = pNext)
+    {
+        pNext = pSegment->next;
+        pSegment->next = 0;
+        __skb_queue_tail(pQueue, pSegment);
+    }
+    return 0;
+}
+#endif /* VBOXNETFLT_WITH_GSO_XMIT_WIRE */
+
 /**
  * Internal worker that create a linux sk_buff for a
  * (scatter/)gather list.
@@ -498,6 +895,10 @@ static struct sk_buff *vboxNetFltLinuxSkBufFromSG(PVBOXNETFLTINS pThis, PINTNETS
     struct sk_buff *pPkt;
     struct net_device *pDev;
     unsigned fGsoType = 0;
+#ifdef VBOXNETFLT_WITH_HOST_CSUM_COMPLETE
+    bool     fCsumComplete = false;
+    uint32_t u32Sum = 0;
+#endif
 
     if (pSG->cbTotal == 0)
     {
@@ -519,15 +920,52 @@ static struct sk_buff *vboxNetFltLinuxSkBufFromSG(PVBOXNETFLTINS pThis, PINTNETS
         pSG->pvUserData = NULL;
         return NULL;
     }
-    pPkt->dev       = pDev;
-    pPkt->ip_summed = CHECKSUM_NONE;
 
     /* Align IP header on 16-byte boundary: 2 + 14 (ethernet hdr size). */
     skb_reserve(pPkt, NET_IP_ALIGN);
 
-    /* Copy the segments. */
+    /*
+     * Copy the segments.  Frames for the wire that the NIC takes as they
+     * are won't be touched by the CPU again, so large ones shouldn't push
+     * everything else out of the cache.  Frames for the host get their
+     * checksum calculated on the way, which spares the stack another
+     * pass over the data when it verifies the transport checksum.
+     */
     skb_put(pPkt, pSG->cbTotal);
-    IntNetSgRead(pSG, pPkt->data);
+    if (fDstWire)
+    {
+#ifdef VBOXNETFLT_WITH_GSO_XMIT_WIRE
+        if (   pSG->GsoCtx.u8Type == PDMNETWORKGSOTYPE_INVALID
+            || vboxNetFltLinuxCanOffloadGso(pThis, pDev, pSG))
+#else
+        if (pSG->GsoCtx.u8Type == PDMNETWORKGSOTYPE_INVALID)
+#endif
+            IntNetSgReadNt(pSG, pPkt->data);
+        else
+            IntNetSgRead(pSG, pPkt->data);
+    }
+#ifdef VBOXNETFLT_WITH_HOST_CSUM_COMPLETE
+    else if (   pSG->GsoCtx.u8Type == PDMNETWORKGSOTYPE_INVALID
+             && pSG->cbTotal > ETH_HLEN)
+    {
+        /* eth_type_trans pulls the ethernet header, the sum covers the rest. */
+        bool fOdd = false;
+        IntNetSgReadEx(pSG, 0, ETH_HLEN, pPkt->data);
+        u32Sum = IntNetSgReadExAndChecksum(pSG, ETH_HLEN, pSG->cbTotal - ETH_HLEN, pPkt->data + ETH_HLEN, 0, &fOdd);
+        fCsumComplete = true;
+    }
+#endif
+    else
+        IntNetSgRead(pSG, pPkt->data);
+    pPkt->dev       = pDev;
+    pPkt->ip_summed = CHECKSUM_NONE;
+#ifdef VBOXNETFLT_WITH_HOST_CSUM_COMPLETE
+    if (fCsumComplete)
+    {
+        pPkt->csum      = (__force __wsum)u32Sum;
+        pPkt->ip_summed = CHECKSUM_COMPLETE;
+    }
+#endif
 
 #if defined(VBOXNETFLT_WITH_GSO_XMIT_WIRE) || defined(VBOXNETFLT_WITH_GSO_XMIT_HOST)
     /*
@@ -550,6 +988,9 @@ static struct sk_buff *vboxNetFltLinuxSkBufFromSG(PVBOXNETFLTINS pThis, PINTNETS
         case PDMNETWORKGSOTYPE_IPV6_TCP:
             fGsoType = SKB_GSO_TCPV6;
             break;
+        case PDMNETWORKGSOTYPE_IPV6_UDP:
+            fGsoType = SKB_GSO_UDP;
+            break;
     }
     if (fGsoType)
     {
@@ -580,8 +1021,12 @@ static struct sk_buff *vboxNetFltLinuxSkBufFromSG(PVBOXNETFLTINS pThis, PINTNETS
                 pPkt->csum = RT_OFFSETOF(RTNETUDP, uh_sum);
 # endif
         }
-        if (!fDstWire)
-            PDMNetGsoPrepForDirectUse(&pSG->GsoCtx, pPkt->data, pSG->cbTotal, PDMNETCSUMTYPE_PSEUDO);
+        /*
+         * CHECKSUM_PARTIAL wants the pseudo header checksum in the transport
+         * header, both for the NIC and for software segmentation.  Only the
+         * headers are touched, so this works for fragmented buffers too.
+         */
+        PDMNetGsoPrepForDirectUse(&pSG->GsoCtx, pPkt->data, pSG->cbTotal, PDMNETCSUMTYPE_PSEUDO);
     }
 #endif /* VBOXNETFLT_WITH_GSO_XMIT_WIRE || VBOXNETFLT_WITH_GSO_XMIT_HOST */
 
@@ -621,29 +1066,50 @@ DECLINLINE(void) vboxNetFltLinuxSkBufToSG(PVBOXNETFLTINS pThis, struct sk_buff *
                                           unsigned cSegs, uint32_t fSrc, PCPDMNETWORKGSO pGsoCtx)
 {
     int i;
+#ifdef VBOXNETFLT_SG_SUPPORT
+    struct sk_buff *pCur;
+#endif
     NOREF(pThis);
 
-    Assert(!skb_shinfo(pBuf)->frag_list);
-
     if (!pGsoCtx)
         IntNetSgInitTempSegs(pSG, pBuf->len, cSegs, 0 /*cSegsUsed*/);
     else
         IntNetSgInitTempSegsGso(pSG, pBuf->len, cSegs, 0 /*cSegsUsed*/, pGsoCtx);
 
 #ifdef VBOXNETFLT_SG_SUPPORT
-    pSG->aSegs[0].cb = skb_headlen(pBuf);
-    pSG->aSegs[0].pv = pBuf->data;
-    pSG->aSegs[0].Phys = NIL_RTHCPHYS;
-
-    for (i = 0; i < skb_shinfo(pBuf)->nr_frags; i++)
+    /*
+     * Map the head and page fragments of the socket buffer and then those of
+     * each frag_list member.  vboxNetFltLinuxPrepareSkBufForSG has made sure
+     * none of the pages live in high memory, so page_address is sufficient.
+     */
+    i = 0;
+    pCur = pBuf;
+    do
     {
-        skb_frag_t *pFrag = &skb_shinfo(pBuf)->frags[i];
-        pSG->aSegs[i+1].cb = pFrag->size;
-        pSG->aSegs[i+1].pv = kmap(pFrag->page);
-        printk("%p = kmap()\n", pSG->aSegs[i+1].pv);
-        pSG->aSegs[i+1].Phys = NIL_RTHCPHYS;
-    }
-    ++i;
+        int iFrag;
+
+        if (pCur == pBuf || skb_headlen(pCur))
+        {
+            pSG->aSegs[i].cb   = skb_headlen(pCur);
+            pSG->aSegs[i].pv   = pCur->data;
+            pSG->aSegs[i].Phys = NIL_RTHCPHYS;
+            i++;
+        }
+
+        for (iFrag = 0; iFrag < skb_shinfo(pCur)->nr_frags; iFrag++)
+        {
+            skb_frag_t *pFrag = &skb_shinfo(pCur)->frags[iFrag];
+            Assert(!PageHighMem(pFrag->page));
+            pSG->aSegs[i].cb   = pFrag->size;
+            pSG->aSegs[i].pv   = (uint8_t *)page_address(pFrag->page) + pFrag->page_offset;
+            pSG->aSegs[i].Phys = NIL_RTHCPHYS;
+            i++;
+        }
+
+        Assert(pCur == pBuf || !skb_shinfo(pCur)->frag_list);
+        pCur = pCur == pBuf ? skb_shinfo(pBuf)->frag_list : pCur->next;
+    } while (pCur);
+    Assert((unsigned)i <= cSegs);
 
 #else
     pSG->aSegs[0].cb = pBuf->len;
@@ -739,40 +1205,23 @@ static int vboxNetFltLinuxPacketHandler(struct sk_buff *pBuf,
         return 0;
     }
 
-#ifndef VBOXNETFLT_SG_SUPPORT
+    /*
+     * The sk_buff is shared with the other packet taps and the stack, get our
+     * own reference to it.  A clone shares the data, so there is no copying.
+     */
+    pBuf = skb_share_check(pBuf, GFP_ATOMIC);
+    if (!pBuf)
     {
-        /*
-         * Get rid of fragmented packets, they cause too much trouble.
-         */
-        struct sk_buff *pCopy = skb_copy(pBuf, GFP_ATOMIC);
-        kfree_skb(pBuf);
-        if (!pCopy)
-        {
-            LogRel(("VBoxNetFlt: Failed to allocate packet buffer, dropping the packet.\n"));
-            return 0;
-        }
-        pBuf = pCopy;
-# if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 18)
-        Log3(("vboxNetFltLinuxPacketHandler: skb copy len=%u data_len=%u truesize=%u next=%p nr_frags=%u gso_size=%u gso_seqs=%u gso_type=%x frag_list=%p pkt_type=%x\n",
-              pBuf->len, pBuf->data_len, pBuf->truesize, pBuf->next, skb_shinfo(pBuf)->nr_frags, skb_shinfo(pBuf)->gso_size, skb_shinfo(pBuf)->gso_segs, skb_shinfo(pBuf)->gso_type, skb_shinfo(pBuf)->frag_list, pBuf->pkt_type));
-        Log4(("vboxNetFltLinuxPacketHandler: packet dump follows:\n%.*Rhxd\n", pBuf->len-pBuf->data_len, skb_mac_header(pBuf)));
-# else
-        Log3(("vboxNetFltLinuxPacketHandler: skb copy len=%u data_len=%u truesize=%u next=%p nr_frags=%u tso_size=%u tso_seqs=%u frag_list=%p pkt_type=%x\n",
-              pBuf->len, pBuf->data_len, pBuf->truesize, pBuf->next, skb_shinfo(pBuf)->nr_frags, skb_shinfo(pBuf)->tso_size, skb_shinfo(pBuf)->tso_segs, skb_shinfo(pBuf)->frag_list, pBuf->pkt_type));
-# endif
+        LogRel(("VBoxNetFlt: Failed to clone packet buffer, dropping the packet.\n"));
+        return 0;
     }
-#endif
 
-#ifdef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-    /* Forward it to the internal network. */
-    vboxNetFltLinuxForwardToIntNet(pThis, pBuf);
-#else
-    /* Add the packet to transmit queue and schedule the bottom half. */
-    skb_queue_tail(&pThis->u.s.XmitQueue, pBuf);
-    schedule_work(&pThis->u.s.XmitTask);
-    Log4(("vboxNetFltLinuxPacketHandler: scheduled work %p for sk_buff %p\n",
-          &pThis->u.s.XmitTask, pBuf));
-#endif
+    /*
+     * Forward it to the internal network right away if the policy allows
+     * it, otherwise add it to this CPU's receive queue and schedule its poll.
+     */
+    if (!vboxNetFltLinuxRxDirect(pThis, pBuf))
+        vboxNetFltLinuxRxQueueAdd(pThis, pBuf);
 
     /* It does not really matter what we return, it is ignored by the kernel. */
     return 0;
@@ -787,7 +1236,10 @@ static int vboxNetFltLinuxPacketHandler(struct sk_buff *pBuf,
 DECLINLINE(unsigned) vboxNetFltLinuxCalcSGSegments(struct sk_buff *pBuf)
 {
 #ifdef VBOXNETFLT_SG_SUPPORT
+    struct sk_buff *pCur;
     unsigned cSegs = 1 + skb_shinfo(pBuf)->nr_frags;
+    for (pCur = skb_shinfo(pBuf)->frag_list; pCur; pCur = pCur->next)
+        cSegs += 1 + skb_shinfo(pCur)->nr_frags;
 #else
     unsigned cSegs = 1;
 #endif
@@ -800,20 +1252,64 @@ DECLINLINE(unsigned) vboxNetFltLinuxCalcSGSegments(struct sk_buff *pBuf)
 }
 
 /**
- * Destroy the intnet scatter / gather buffer created by
- * vboxNetFltLinuxSkBufToSG.
+ * Makes sure vboxNetFltLinuxSkBufToSG can describe the socket buffer without
+ * mapping anything, linearizing it if necessary.
+ *
+ * This is the case when the socket buffer has page fragments in high memory
+ * (kmap may sleep and we're called in softirq context) or when it has more
+ * segments than we are willing to put on the stack.  Both are rare, so the
+ * common case forwards the frame with zero copies.
+ *
+ * @returns true if the sk_buff is ready, false if linearizing failed.
+ * @param   pBuf                The socket buffer.
  */
-static void vboxNetFltLinuxDestroySG(PINTNETSG pSG)
+static bool vboxNetFltLinuxPrepareSkBufForSG(struct sk_buff *pBuf)
 {
 #ifdef VBOXNETFLT_SG_SUPPORT
-    int i;
-
-    for (i = 0; i < skb_shinfo(pBuf)->nr_frags; i++)
+    bool fLinearize = vboxNetFltLinuxCalcSGSegments(pBuf) > VBOXNETFLT_LINUX_MAX_SEGS;
+# ifdef CONFIG_HIGHMEM
+    struct sk_buff *pCur = pBuf;
+    while (!fLinearize && pCur)
+    {
+        int iFrag;
+        for (iFrag = 0; iFrag < skb_shinfo(pCur)->nr_frags; iFrag++)
+            if (PageHighMem(skb_shinfo(pCur)->frags[iFrag].page))
+            {
+                fLinearize = true;
+                break;
+            }
+        pCur = pCur == pBuf ? skb_shinfo(pBuf)->frag_list : pCur->next;
+    }
+# endif
+    if (fLinearize)
+    {
+        Log3(("vboxNetFltLinuxPrepareSkBufForSG: linearizing skb len=%u data_len=%u nr_frags=%u frag_list=%p\n",
+              pBuf->len, pBuf->data_len, skb_shinfo(pBuf)->nr_frags, skb_shinfo(pBuf)->frag_list));
+        if (VBOX_SKB_LINEARIZE(pBuf))
+        {
+            LogRel(("VBoxNetFlt: Failed to linearize packet buffer, dropping the packet.\n"));
+            return false;
+        }
+    }
+#else
+    if (skb_is_nonlinear(pBuf) && VBOX_SKB_LINEARIZE(pBuf))
     {
-        printk("kunmap(%p)\n", pSG->aSegs[i+1].pv);
-        kunmap(pSG->aSegs[i+1].pv);
+        LogRel(("VBoxNetFlt: Failed to linearize packet buffer, dropping the packet.\n"));
+        return false;
     }
 #endif
+    return true;
+}
+
+/**
+ * Destroy the intnet scatter / gather buffer created by
+ * vboxNetFltLinuxSkBufToSG.
+ *
+ * The segments point straight into the socket buffer, so there is nothing to
+ * unmap; the sk_buff is released by the caller.
+ */
+static void vboxNetFltLinuxDestroySG(PINTNETSG pSG)
+{
     NOREF(pSG);
 }
 
@@ -1074,8 +1570,14 @@ static bool vboxNetFltLinuxCanForwardAsGso(PVBOXNETFLTINS pThis, struct sk_buff
 static int vboxNetFltLinuxForwardAsGso(PVBOXNETFLTINS pThis, struct sk_buff *pSkb, uint32_t fSrc, PCPDMNETWORKGSO pGsoCtx)
 {
     int         rc;
-    unsigned    cSegs = vboxNetFltLinuxCalcSGSegments(pSkb);
-    if (RT_LIKELY(cSegs <= MAX_SKB_FRAGS + 1))
+    unsigned    cSegs;
+    if (RT_UNLIKELY(!vboxNetFltLinuxPrepareSkBufForSG(pSkb)))
+    {
+        dev_kfree_skb(pSkb);
+        return VERR_NO_MEMORY;
+    }
+    cSegs = vboxNetFltLinuxCalcSGSegments(pSkb);
+    if (RT_LIKELY(cSegs <= VBOXNETFLT_LINUX_MAX_SEGS))
     {
         PINTNETSG pSG = (PINTNETSG)alloca(RT_OFFSETOF(INTNETSG, aSegs[cSegs]));
         if (RT_LIKELY(pSG))
@@ -1118,8 +1620,14 @@ static int vboxNetFltLinuxForwardAsGso(PVBOXNETFLTINS pThis, struct sk_buff *pSk
 static int vboxNetFltLinuxForwardSegment(PVBOXNETFLTINS pThis, struct sk_buff *pBuf, uint32_t fSrc)
 {
     int         rc;
-    unsigned    cSegs = vboxNetFltLinuxCalcSGSegments(pBuf);
-    if (cSegs <= MAX_SKB_FRAGS + 1)
+    unsigned    cSegs;
+    if (RT_UNLIKELY(!vboxNetFltLinuxPrepareSkBufForSG(pBuf)))
+    {
+        dev_kfree_skb(pBuf);
+        return VERR_NO_MEMORY;
+    }
+    cSegs = vboxNetFltLinuxCalcSGSegments(pBuf);
+    if (cSegs <= VBOXNETFLT_LINUX_MAX_SEGS)
     {
         PINTNETSG pSG = (PINTNETSG)alloca(RT_OFFSETOF(INTNETSG, aSegs[cSegs]));
         if (RT_LIKELY(pSG))
@@ -1164,7 +1672,19 @@ static int vboxNetFltLinuxForwardSegment(PVBOXNETFLTINS pThis, struct sk_buff *p
  */
 static void vboxNetFltLinuxForwardToIntNet(PVBOXNETFLTINS pThis, struct sk_buff *pBuf)
 {
-    uint32_t fSrc = pBuf->pkt_type == PACKET_OUTGOING ? INTNETTRUNKDIR_HOST : INTNETTRUNKDIR_WIRE;
+    uint32_t                 fSrc      = pBuf->pkt_type == PACKET_OUTGOING ? INTNETTRUNKDIR_HOST : INTNETTRUNKDIR_WIRE;
+    PVBOXNETFLTLINUXCOUNTERS pCounters = &per_cpu_ptr(pThis->u.s.pRxQueues, smp_processor_id())->Counters;
+
+    u64_stats_update_begin(&pCounters->Sync);
+    pCounters->cRxPackets++;
+    pCounters->cRxBytes += pBuf->len;
+#ifdef VBOXNETFLT_WITH_GSO
+    if (skb_is_gso(pBuf))
+        pCounters->cGsoFrames++;
+#endif
+    if (pBuf->ip_summed == CHECKSUM_PARTIAL)
+        pCounters->cCsumOffload++;
+    u64_stats_update_end(&pCounters->Sync);
 
 #ifdef VBOXNETFLT_WITH_GSO
     if (skb_is_gso(pBuf))
@@ -1231,44 +1751,605 @@ static void vboxNetFltLinuxForwardToIntNet(PVBOXNETFLTINS pThis, struct sk_buff
     }
 }
 
-#ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
 /**
- * Work queue handler that forwards the socket buffers queued by
- * vboxNetFltLinuxPacketHandler to the internal network.
+ * Adds a latency sample to a log2 histogram.
  *
- * @param   pWork               The work queue.
+ * @param   pacBuckets          The histogram (VBOXNETFLT_LINUX_HIST_BUCKETS).
+ * @param   cNs                 The latency in nanoseconds.
  */
-# if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 20)
-static void vboxNetFltLinuxXmitTask(struct work_struct *pWork)
-# else
-static void vboxNetFltLinuxXmitTask(void *pWork)
-# endif
+DECLINLINE(void) vboxNetFltLinuxHistAdd(uint64_t *pacBuckets, uint64_t cNs)
 {
-    PVBOXNETFLTINS  pThis   = VBOX_FLT_XT_TO_INST(pWork);
-    struct sk_buff *pBuf;
-
-    Log4(("vboxNetFltLinuxXmitTask: Got work %p.\n", pWork));
+    unsigned iBucket = cNs > UINT32_MAX ? 31 : ASMBitLastSetU32((uint32_t)cNs);
+    if (iBucket > 0)
+        iBucket--;
+    pacBuckets[RT_MIN(iBucket, VBOXNETFLT_LINUX_HIST_BUCKETS - 1)]++;
+}
 
-    /*
-     * Active? Retain the instance and increment the busy counter.
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+/**
+ * Checks whether the instance is listed in an interface list module parameter
+ * (datapath_stats).
+ *
+ * @returns true / false accordingly.
+ * @param   pThis               The net filter instance.
+ * @param   pszList             Comma separated interface names, "*" matches all.
+ */
+static bool vboxNetFltLinuxIsListed(PVBOXNETFLTINS pThis, const char *pszList)
+{
+    const char *psz   = pszList;
+    size_t      cchName = strlen(pThis->szName);
+
+    while (*psz)
+    {
+        const char *pszEnd = strchr(psz, ',');
+        size_t      cch    = pszEnd ? (size_t)(pszEnd - psz) : strlen(psz);
+        if (cch > 0 && psz[cch - 1] == '\n') /* echo adds one */
+            cch--;
+        if (   (cch == 1 && *psz == '*')
+            || (cch == cchName && !memcmp(psz, pThis->szName, cch)))
+            return true;
+        if (!pszEnd)
+            break;
+        psz = pszEnd + 1;
+    }
+    return false;
+}
+#endif
+
+/**
+ * Decides whether to forward a received frame directly (rx_direct policy)
+ * and does so if it is.
+ *
+ * Direct forwarding saves the queueing and tasklet round trip but makes the
+ * caller wait for the switch.  Linear non-GSO frames are cheap to forward,
+ * GSO and fragmented frames may need segmenting or linearizing and are
+ * better left to the poll.
+ *
+ * Frames only take the direct path while the receive queue of this CPU is
+ * empty, otherwise they would overtake the frames of the same flow waiting
+ * in it.  They are queued behind the backlog instead.
+ *
+ * @returns true if the frame was forwarded (consumed), false if the caller
+ *          should queue it.
+ * @param   pThis               The net filter instance.
+ * @param   pBuf                The socket buffer.
+ */
+static bool vboxNetFltLinuxRxDirect(PVBOXNETFLTINS pThis, struct sk_buff *pBuf)
+{
+    int const       iPolicy = rx_direct;
+    uint64_t        u64Start = 0;
+
+    if (iPolicy == VBOXNETFLT_RX_DIRECT_NEVER)
+        return false;
+    if (   iPolicy == VBOXNETFLT_RX_DIRECT_LINEAR
+        && (   skb_is_nonlinear(pBuf)
+#ifdef VBOXNETFLT_WITH_GSO
+            || skb_is_gso(pBuf)
+#endif
+            || !in_softirq()))
+        return false;
+    if (!skb_queue_empty(&per_cpu_ptr(pThis->u.s.pRxQueues, smp_processor_id())->Queue))
+        return false;
+
+    /* Inactive trunks are handled by the queue drain policy. */
+    if (!vboxNetFltTryRetainBusyActive(pThis))
+        return false;
+
+    if (pThis->u.s.pStats)
+        u64Start = RTTimeSystemNanoTS();
+    vboxNetFltLinuxForwardToIntNet(pThis, pBuf);
+    if (u64Start) /* pStats may get set while we're here */
+        vboxNetFltLinuxHistAdd(per_cpu_ptr(pThis->u.s.pStats, smp_processor_id())->acDirectLatency,
+                               RTTimeSystemNanoTS() - u64Start);
+
+    vboxNetFltRelease(pThis, true /* fBusy */);
+    return true;
+}
+
+/**
+ * Removes the oldest frame from a receive queue and updates the age
+ * statistics.
+ *
+ * @returns The socket buffer, NULL if the queue is empty.
+ * @param   pRxQ                The receive queue.
+ * @param   cMsMin              Only dequeue the frame if it has waited at least
+ *                              this many milliseconds.  0 for any frame.
+ */
+static struct sk_buff *vboxNetFltLinuxRxQueueDequeue(PVBOXNETFLTLINUXRXQ pRxQ, unsigned cMsMin)
+{
+    struct sk_buff *pBuf;
+    unsigned long   flags;
+    uint32_t        cMsAge;
+    uint64_t const  u64Now = RTTimeSystemNanoTS();
+
+    spin_lock_irqsave(&pRxQ->Queue.lock, flags);
+    pBuf = skb_peek(&pRxQ->Queue);
+    if (pBuf)
+    {
+        cMsAge = (uint32_t)((u64Now - VBOXNETFLT_SKB_RXQ_TS(pBuf)) / UINT64_C(1000000));
+        if (cMsAge >= cMsMin)
+            __skb_unlink(pBuf, &pRxQ->Queue);
+        else
+            pBuf = NULL;
+    }
+    spin_unlock_irqrestore(&pRxQ->Queue.lock, flags);
+
+    if (pBuf && cMsAge > pRxQ->cMsMaxAge)
+        pRxQ->cMsMaxAge = cMsAge;
+    return pBuf;
+}
+
+/**
+ * Returns how long the oldest frame of a receive queue has been waiting.
+ *
+ * @returns The age in milliseconds, UINT32_MAX if the queue is empty.
+ * @param   pRxQ                The receive queue.
+ */
+static uint32_t vboxNetFltLinuxRxQueueHeadAge(PVBOXNETFLTLINUXRXQ pRxQ)
+{
+    struct sk_buff *pBuf;
+    unsigned long   flags;
+    uint32_t        cMsAge = UINT32_MAX;
+    uint64_t const  u64Now = RTTimeSystemNanoTS();
+
+    spin_lock_irqsave(&pRxQ->Queue.lock, flags);
+    pBuf = skb_peek(&pRxQ->Queue);
+    if (pBuf)
+        cMsAge = (uint32_t)((u64Now - VBOXNETFLT_SKB_RXQ_TS(pBuf)) / UINT64_C(1000000));
+    spin_unlock_irqrestore(&pRxQ->Queue.lock, flags);
+    return cMsAge;
+}
+
+/**
+ * Receive queue poll (tasklet) that forwards the socket buffers queued by
+ * vboxNetFltLinuxPacketHandler to the internal network.
+ *
+ * At most VBOXNETFLT_LINUX_RXQ_BUDGET frames are forwarded per run, the
+ * tasklet reschedules itself on the same CPU if there are more.
+ *
+ * While the instance is inactive (VM paused, trunk suspended) the frames are
+ * kept for rxq_inactive_drain_ms so a short pause does not lose traffic, and
+ * dropped after that.  When frames are left waiting, the queue timer is armed
+ * for the moment the oldest one reaches that age, so they are dropped even if
+ * nothing else arrives.  vboxNetFltPortOsSetActive kicks the queues when the
+ * trunk becomes active again.  Together with rxq_max_depth this bounds the
+ * memory a paused VM on a busy bridge can pin.
+ *
+ * @param   uData               The receive queue (PVBOXNETFLTLINUXRXQ).
+ */
+static void vboxNetFltLinuxRxQueuePoll(unsigned long uData)
+{
+    PVBOXNETFLTLINUXRXQ pRxQ  = (PVBOXNETFLTLINUXRXQ)uData;
+    PVBOXNETFLTINS      pThis = pRxQ->pThis;
+    struct sk_buff     *pBuf;
+    unsigned            cLeft = VBOXNETFLT_LINUX_RXQ_BUDGET;
+
+    Log4(("vboxNetFltLinuxRxQueuePoll: pRxQ=%p depth=%u\n", pRxQ, skb_queue_len(&pRxQ->Queue)));
+
+    /*
+     * Active? Retain the instance and increment the busy counter once for
+     * the whole burst.
      */
     if (vboxNetFltTryRetainBusyActive(pThis))
     {
-        while ((pBuf = skb_dequeue(&pThis->u.s.XmitQueue)) != NULL)
+        PVBOXNETFLTLINUXSTATS pStats = pThis->u.s.pStats ? per_cpu_ptr(pThis->u.s.pStats, smp_processor_id()) : NULL;
+        while (cLeft-- > 0 && (pBuf = vboxNetFltLinuxRxQueueDequeue(pRxQ, 0)) != NULL)
+        {
+            uint64_t const u64Enqueued = VBOXNETFLT_SKB_RXQ_TS(pBuf);
             vboxNetFltLinuxForwardToIntNet(pThis, pBuf);
+            if (pStats)
+                vboxNetFltLinuxHistAdd(pStats->acQueuedLatency, RTTimeSystemNanoTS() - u64Enqueued);
+        }
 
         vboxNetFltRelease(pThis, true /* fBusy */);
+
+        if (!skb_queue_empty(&pRxQ->Queue))
+            tasklet_schedule(&pRxQ->Tasklet);
     }
     else
     {
-        /** @todo Shouldn't we just drop the packets here? There is little point in
-         *        making them accumulate when the VM is paused and it'll only waste
-         *        kernel memory anyway... Hmm. maybe wait a short while (2-5 secs)
-         *        before start draining the packets (goes for the intnet ring buf
-         *        too)? */
+        /*
+         * Drain the frames that have been waiting for too long.  The queue is
+         * in arrival order, so we can stop at the first young frame and arm
+         * the timer for when it gets old enough.
+         */
+        unsigned const cMsDrain = rxq_inactive_drain_ms;
+        uint32_t       cMsAge;
+        while ((pBuf = vboxNetFltLinuxRxQueueDequeue(pRxQ, cMsDrain)) != NULL)
+        {
+            pRxQ->cAgeDrops++;
+            u64_stats_update_begin(&pRxQ->Counters.Sync);
+            pRxQ->Counters.cRxDrops++;
+            u64_stats_update_end(&pRxQ->Counters.Sync);
+            dev_kfree_skb(pBuf);
+        }
+
+        cMsAge = vboxNetFltLinuxRxQueueHeadAge(pRxQ);
+        if (   cMsAge != UINT32_MAX
+            && !ASMAtomicReadBool(&pRxQ->fStopping)
+            && !timer_pending(&pRxQ->Timer))
+        {
+            /* The timer and this tasklet both run in softirq context on this
+               CPU, so they cannot race each other here. */
+            pRxQ->Timer.expires = jiffies + msecs_to_jiffies(cMsAge < cMsDrain ? cMsDrain - cMsAge : 0) + 1;
+            add_timer_on(&pRxQ->Timer, smp_processor_id());
+        }
+    }
+}
+
+/**
+ * Receive queue timer that reschedules the poll once the oldest frame left
+ * waiting by an inactive instance has reached the drain age.
+ */
+static void vboxNetFltLinuxRxQueueTimer(unsigned long uData)
+{
+    PVBOXNETFLTLINUXRXQ pRxQ = (PVBOXNETFLTLINUXRXQ)uData;
+    if (!ASMAtomicReadBool(&pRxQ->fStopping))
+        tasklet_schedule(&pRxQ->Tasklet);
+}
+
+/**
+ * Reschedules the poll of a receive queue on the CPU owning it
+ * (RTMpOnSpecific callback).
+ *
+ * @param   idCpu               The CPU we're running on.
+ * @param   pvUser1             The receive queue (PVBOXNETFLTLINUXRXQ).
+ * @param   pvUser2             Not used.
+ */
+static DECLCALLBACK(void) vboxNetFltLinuxRxQueueKickWorker(RTCPUID idCpu, void *pvUser1, void *pvUser2)
+{
+    PVBOXNETFLTLINUXRXQ pRxQ = (PVBOXNETFLTLINUXRXQ)pvUser1;
+    NOREF(idCpu); NOREF(pvUser2);
+    tasklet_schedule(&pRxQ->Tasklet);
+}
+
+/**
+ * Kicks the polls of all receive queues holding frames, so frames kept while
+ * the instance was inactive are forwarded as soon as it becomes active.
+ *
+ * The polls are scheduled on the CPUs owning the queues since the per-CPU
+ * counters must only be updated there.
+ *
+ * @param   pThis               The net filter instance.
+ */
+static void vboxNetFltLinuxRxQueuesKick(PVBOXNETFLTINS pThis)
+{
+    int iCpu;
+
+    if (!pThis->u.s.pRxQueues)
+        return;
+
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETFLTLINUXRXQ pRxQ = per_cpu_ptr(pThis->u.s.pRxQueues, iCpu);
+        if (!skb_queue_empty(&pRxQ->Queue))
+        {
+            int rc = RTMpOnSpecific(RTMpCpuIdFromSetIndex(iCpu), vboxNetFltLinuxRxQueueKickWorker, pRxQ, NULL);
+            if (RT_FAILURE(rc))
+                Log(("vboxNetFltLinuxRxQueuesKick: cpu %d: rc=%Rrc\n", iCpu, rc));
+        }
+    }
+}
+
+/**
+ * Appends a socket buffer to the receive queue of the current CPU and
+ * schedules the poll.
+ *
+ * @param   pThis               The net filter instance.
+ * @param   pBuf                The socket buffer.  This is consumed.
+ */
+static void vboxNetFltLinuxRxQueueAdd(PVBOXNETFLTINS pThis, struct sk_buff *pBuf)
+{
+    PVBOXNETFLTLINUXRXQ pRxQ   = per_cpu_ptr(pThis->u.s.pRxQueues, smp_processor_id());
+    uint32_t            cDepth = skb_queue_len(&pRxQ->Queue);
+
+    if (RT_UNLIKELY(cDepth >= rxq_max_depth))
+    {
+        pRxQ->cDrops++;
+        u64_stats_update_begin(&pRxQ->Counters.Sync);
+        pRxQ->Counters.cRxDrops++;
+        u64_stats_update_end(&pRxQ->Counters.Sync);
+        Log4(("vboxNetFltLinuxRxQueueAdd: queue %p full, dropping sk_buff %p\n", pRxQ, pBuf));
+        dev_kfree_skb(pBuf);
+    }
+    else
+    {
+        VBOXNETFLT_SKB_RXQ_TS(pBuf) = RTTimeSystemNanoTS();
+        skb_queue_tail(&pRxQ->Queue, pBuf);
+        if (cDepth + 1 > pRxQ->cMaxDepth)
+            pRxQ->cMaxDepth = cDepth + 1;
+        if (pThis->u.s.pStats)
+            vboxNetFltLinuxHistAdd(per_cpu_ptr(pThis->u.s.pStats, smp_processor_id())->acQueueDepth, cDepth + 1);
+    }
+    /* Schedule even when dropping, the poll drains the queue while inactive. */
+    tasklet_schedule(&pRxQ->Tasklet);
+}
+
+/**
+ * Sums up the receive queue statistics of an instance over all CPUs.
+ *
+ * @param   pThis               The net filter instance.
+ * @param   pStats              Where to return the statistics.
+ */
+static void vboxNetFltLinuxRxQueuesQueryStats(PVBOXNETFLTINS pThis, PVBOXNETFLTLINUXRXQSTATS pStats)
+{
+    int iCpu;
+
+    memset(pStats, 0, sizeof(*pStats));
+    if (!pThis->u.s.pRxQueues)
+        return;
+
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETFLTLINUXRXQ pRxQ = per_cpu_ptr(pThis->u.s.pRxQueues, iCpu);
+        pStats->cQueued   += skb_queue_len(&pRxQ->Queue);
+        pStats->cMaxDepth  = RT_MAX(pStats->cMaxDepth, pRxQ->cMaxDepth);
+        pStats->cMsMaxAge  = RT_MAX(pStats->cMsMaxAge, pRxQ->cMsMaxAge);
+        pStats->cDrops    += pRxQ->cDrops;
+        pStats->cAgeDrops += pRxQ->cAgeDrops;
+    }
+}
+
+/**
+ * Sums up the datapath counters of an instance over all CPUs.
+ *
+ * @param   pThis               The net filter instance.
+ * @param   pSum                Where to return the sums.  The Sync member
+ *                              is not used.
+ */
+static void vboxNetFltLinuxQueryCounters(PVBOXNETFLTINS pThis, PVBOXNETFLTLINUXCOUNTERS pSum)
+{
+    int iCpu;
+
+    memset(pSum, 0, sizeof(*pSum));
+    if (!pThis->u.s.pRxQueues)
+        return;
+
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETFLTLINUXCOUNTERS pCounters = &per_cpu_ptr(pThis->u.s.pRxQueues, iCpu)->Counters;
+        VBOXNETFLTLINUXCOUNTERS  Snap;
+        unsigned                 uSeq;
+
+        do
+        {
+            uSeq = u64_stats_fetch_begin(&pCounters->Sync);
+            Snap.cRxPackets   = pCounters->cRxPackets;
+            Snap.cRxBytes     = pCounters->cRxBytes;
+            Snap.cRxDrops     = pCounters->cRxDrops;
+            Snap.cTxPackets   = pCounters->cTxPackets;
+            Snap.cTxBytes     = pCounters->cTxBytes;
+            Snap.cTxDrops     = pCounters->cTxDrops;
+            Snap.cGsoFrames   = pCounters->cGsoFrames;
+            Snap.cCsumOffload = pCounters->cCsumOffload;
+        } while (u64_stats_fetch_retry(&pCounters->Sync, uSeq));
+
+        pSum->cRxPackets   += Snap.cRxPackets;
+        pSum->cRxBytes     += Snap.cRxBytes;
+        pSum->cRxDrops     += Snap.cRxDrops;
+        pSum->cTxPackets   += Snap.cTxPackets;
+        pSum->cTxBytes     += Snap.cTxBytes;
+        pSum->cTxDrops     += Snap.cTxDrops;
+        pSum->cGsoFrames   += Snap.cGsoFrames;
+        pSum->cCsumOffload += Snap.cCsumOffload;
+    }
+}
+
+/**
+ * Allocates and initializes the per-CPU receive queues.
+ *
+ * @returns VBox status code.
+ * @param   pThis               The net filter instance.
+ */
+static int vboxNetFltLinuxRxQueuesCreate(PVBOXNETFLTINS pThis)
+{
+    int iCpu;
+
+    pThis->u.s.pRxQueues = alloc_percpu(VBOXNETFLTLINUXRXQ);
+    if (!pThis->u.s.pRxQueues)
+        return VERR_NO_MEMORY;
+
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETFLTLINUXRXQ pRxQ = per_cpu_ptr(pThis->u.s.pRxQueues, iCpu);
+        skb_queue_head_init(&pRxQ->Queue);
+        tasklet_init(&pRxQ->Tasklet, vboxNetFltLinuxRxQueuePoll, (unsigned long)pRxQ);
+        init_timer(&pRxQ->Timer);
+        pRxQ->Timer.function = vboxNetFltLinuxRxQueueTimer;
+        pRxQ->Timer.data     = (unsigned long)pRxQ;
+        pRxQ->fStopping = false;
+        pRxQ->pThis     = pThis;
+        pRxQ->cDrops    = 0;
+        pRxQ->cAgeDrops = 0;
+        pRxQ->cMaxDepth = 0;
+        pRxQ->cMsMaxAge = 0;
+        memset(&pRxQ->Counters, 0, sizeof(pRxQ->Counters));
+        u64_stats_init(&pRxQ->Counters.Sync);
+    }
+    return VINF_SUCCESS;
+}
+
+/**
+ * Stops the receive queue polls and frees the frames still queued.
+ *
+ * The packet handler must have been removed before calling this.
+ *
+ * @param   pThis               The net filter instance.
+ * @param   pszWhere            The caller, for the release log.
+ */
+static void vboxNetFltLinuxRxQueuesPurge(PVBOXNETFLTINS pThis, const char *pszWhere)
+{
+    VBOXNETFLTLINUXRXQSTATS Stats;
+    VBOXNETFLTLINUXCOUNTERS Counters;
+    int                     iCpu;
+
+    if (!pThis->u.s.pRxQueues)
+        return;
+
+    /*
+     * Stop the tasklets first, then the timers.  The stopping flag keeps
+     * them from rearming each other in the meanwhile.  It is cleared again
+     * as the queues are reused if the interface comes back.
+     */
+    for_each_possible_cpu(iCpu)
+    {
+        PVBOXNETFLTLINUXRXQ pRxQ = per_cpu_ptr(pThis->u.s.pRxQueues, iCpu);
+        ASMAtomicWriteBool(&pRxQ->fStopping, true);
+        tasklet_kill(&pRxQ->Tasklet);
+        del_timer_sync(&pRxQ->Timer);
+        tasklet_kill(&pRxQ->Tasklet);
+        ASMAtomicWriteBool(&pRxQ->fStopping, false);
+    }
+
+    vboxNetFltLinuxRxQueuesQueryStats(pThis, &Stats);
+    LogRel(("VBoxNetFlt: %s: %s receive queues: %u queued, max depth %u, max age %u ms, %llu dropped when full, %llu dropped while inactive\n",
+            pThis->szName, pszWhere, Stats.cQueued, Stats.cMaxDepth, Stats.cMsMaxAge, Stats.cDrops, Stats.cAgeDrops));
+    vboxNetFltLinuxQueryCounters(pThis, &Counters);
+    LogRel(("VBoxNetFlt: %s: %s rx %llu frames / %llu bytes / %llu drops, tx %llu frames / %llu bytes / %llu drops, %llu GSO, %llu checksum offloaded\n",
+            pThis->szName, pszWhere, Counters.cRxPackets, Counters.cRxBytes, Counters.cRxDrops,
+            Counters.cTxPackets, Counters.cTxBytes, Counters.cTxDrops, Counters.cGsoFrames, Counters.cCsumOffload));
+
+    for_each_possible_cpu(iCpu)
+        skb_queue_purge(&per_cpu_ptr(pThis->u.s.pRxQueues, iCpu)->Queue);
+}
+
+/**
+ * Frees the per-CPU receive queues.
+ *
+ * @param   pThis               The net filter instance.
+ */
+static void vboxNetFltLinuxRxQueuesDestroy(PVBOXNETFLTINS pThis)
+{
+    if (pThis->u.s.pRxQueues)
+    {
+        free_percpu(pThis->u.s.pRxQueues);
+        pThis->u.s.pRxQueues = NULL;
+    }
+}
+
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+/**
+ * Prints the summed up per-CPU buckets of a histogram.
+ *
+ * @param   pSeq                The sequence file.
+ * @param   pThis               The net filter instance.
+ * @param   pszName             The histogram name.
+ * @param   offHist             The offset of the histogram in
+ *                              VBOXNETFLTLINUXSTATS.
+ */
+static void vboxNetFltLinuxStatsShowHist(struct seq_file *pSeq, PVBOXNETFLTINS pThis, const char *pszName, size_t offHist)
+{
+    unsigned iBucket;
+    int      iCpu;
+
+    seq_printf(pSeq, "%s:", pszName);
+    for (iBucket = 0; iBucket < VBOXNETFLT_LINUX_HIST_BUCKETS; iBucket++)
+    {
+        uint64_t cSamples = 0;
+        for_each_possible_cpu(iCpu)
+            cSamples += ((uint64_t const *)((uint8_t *)per_cpu_ptr(pThis->u.s.pStats, iCpu) + offHist))[iBucket];
+        seq_printf(pSeq, " %llu", (unsigned long long)cSamples);
     }
+    seq_putc(pSeq, '\n');
+}
+
+/**
+ * Shows the /proc/net/vboxnetflt/<ifname> file.
+ *
+ * @returns 0.
+ * @param   pSeq                The sequence file, private points to the
+ *                              net filter instance.
+ * @param   pvIgn               Ignored.
+ */
+static int vboxNetFltLinuxStatsShow(struct seq_file *pSeq, void *pvIgn)
+{
+    PVBOXNETFLTINS          pThis = (PVBOXNETFLTINS)pSeq->private;
+    VBOXNETFLTLINUXRXQSTATS RxQStats;
+    VBOXNETFLTLINUXCOUNTERS Counters;
+    NOREF(pvIgn);
+
+    vboxNetFltLinuxQueryCounters(pThis, &Counters);
+    vboxNetFltLinuxRxQueuesQueryStats(pThis, &RxQStats);
+
+    seq_printf(pSeq, "rx_packets: %llu\nrx_bytes: %llu\nrx_drops: %llu\ntx_packets: %llu\ntx_bytes: %llu\ntx_drops: %llu\n",
+               (unsigned long long)Counters.cRxPackets, (unsigned long long)Counters.cRxBytes,
+               (unsigned long long)Counters.cRxDrops, (unsigned long long)Counters.cTxPackets,
+               (unsigned long long)Counters.cTxBytes, (unsigned long long)Counters.cTxDrops);
+    seq_printf(pSeq, "gso_frames: %llu\ncsum_offload: %llu\n",
+               (unsigned long long)Counters.cGsoFrames, (unsigned long long)Counters.cCsumOffload);
+    seq_printf(pSeq, "rxq_queued: %u\nrxq_max_depth: %u\nrxq_max_age_ms: %u\nrxq_drops: %llu\nrxq_age_drops: %llu\n",
+               RxQStats.cQueued, RxQStats.cMaxDepth, RxQStats.cMsMaxAge,
+               (unsigned long long)RxQStats.cDrops, (unsigned long long)RxQStats.cAgeDrops);
+    seq_printf(pSeq, "# log2 histograms, bucket N counts samples in [2^N, 2^(N+1)) ns or frames\n");
+    vboxNetFltLinuxStatsShowHist(pSeq, pThis, "rx_direct_ns", RT_OFFSETOF(VBOXNETFLTLINUXSTATS, acDirectLatency));
+    vboxNetFltLinuxStatsShowHist(pSeq, pThis, "rx_queued_ns", RT_OFFSETOF(VBOXNETFLTLINUXSTATS, acQueuedLatency));
+    vboxNetFltLinuxStatsShowHist(pSeq, pThis, "tx_ns", RT_OFFSETOF(VBOXNETFLTLINUXSTATS, acXmitLatency));
+    vboxNetFltLinuxStatsShowHist(pSeq, pThis, "rxq_depth", RT_OFFSETOF(VBOXNETFLTLINUXSTATS, acQueueDepth));
+    return 0;
+}
+
+/**
+ * Opens the /proc/net/vboxnetflt/<ifname> file.
+ */
+static int vboxNetFltLinuxStatsOpen(struct inode *pInode, struct file *pFile)
+{
+    return single_open(pFile, vboxNetFltLinuxStatsShow, PDE(pInode)->data);
+}
+
+static const struct file_operations g_VBoxNetFltLinuxStatsOps =
+{
+    .owner          = THIS_MODULE,
+    .open           = vboxNetFltLinuxStatsOpen,
+    .read           = seq_read,
+    .llseek         = seq_lseek,
+    .release        = single_release,
+};
+
+/**
+ * Sets up the datapath statistics if selected for the instance.
+ *
+ * Failure is not fatal, the instance just goes without statistics.
+ *
+ * @param   pThis               The net filter instance.
+ */
+static void vboxNetFltLinuxStatsCreate(PVBOXNETFLTINS pThis)
+{
+    if (!g_pProcDir || !vboxNetFltLinuxIsListed(pThis, datapath_stats))
+        return;
+
+    pThis->u.s.pStats = alloc_percpu(VBOXNETFLTLINUXSTATS);
+    if (pThis->u.s.pStats)
+    {
+        if (proc_create_data(pThis->szName, 0444, g_pProcDir, &g_VBoxNetFltLinuxStatsOps, pThis))
+        {
+            LogRel(("VBoxNetFlt: %s: datapath statistics in /proc/net/vboxnetflt/%s.\n", pThis->szName, pThis->szName));
+            return;
+        }
+        free_percpu(pThis->u.s.pStats);
+        pThis->u.s.pStats = NULL;
+    }
+    LogRel(("VBoxNetFlt: %s: failed to set up the datapath statistics.\n", pThis->szName));
+}
+
+/**
+ * Removes the /proc entry and frees the datapath statistics.
+ *
+ * The packet handler must have been removed and the receive queue polls
+ * stopped before calling this.
+ *
+ * @param   pThis               The net filter instance.
+ */
+static void vboxNetFltLinuxStatsDestroy(PVBOXNETFLTINS pThis)
+{
+    if (!pThis->u.s.pStats)
+        return;
+
+    /* This waits for readers that have the file open. */
+    remove_proc_entry(pThis->szName, g_pProcDir);
+    free_percpu(pThis->u.s.pStats);
+    pThis->u.s.pStats = NULL;
 }
-#endif /* !VBOXNETFLT_LINUX_NO_XMIT_QUEUE */
+#endif /* VBOXNETFLT_WITH_DATAPATH_STATS */
 
 /**
  * Reports the GSO capabilites of the hardware NIC.
@@ -1300,17 +2381,9 @@ static void vboxNetFltLinuxReportNicGsoCapabilities(PVBOXNETFLTINS pThis)
         if (pThis->pSwitchPort)
         {
             /* Set/update the GSO capabilities of the NIC. */
-            uint32_t fGsoCapabilites = 0;
-            if (fFeatures & NETIF_F_TSO)
-                fGsoCapabilites |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_TCP);
-            if (fFeatures & NETIF_F_TSO6)
-                fGsoCapabilites |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_TCP);
-# if 0 /** @todo GSO: Test UDP offloading (UFO) on linux. */
-            if (fFeatures & NETIF_F_UFO)
-                fGsoCapabilites |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_UDP);
-            if (fFeatures & NETIF_F_UFO)
-                fGsoCapabilites |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_UDP);
-# endif
+            uint32_t fGsoCapabilites = vboxNetFltLinuxGsoCapsFromFeatures(fFeatures);
+            Log(("vboxNetFltLinuxReportNicGsoCapabilities: %s: features=%#lx -> GSO caps %#x\n",
+                 pThis->szName, (unsigned long)fFeatures, fGsoCapabilites));
             pThis->pSwitchPort->pfnReportGsoCapabilities(pThis->pSwitchPort, fGsoCapabilites, INTNETTRUNKDIR_WIRE);
         }
 
@@ -1338,7 +2411,76 @@ static bool vboxNetFltLinuxPromiscuous(PVBOXNETFLTINS pThis)
 }
 
 /**
- * Internal worker for vboxNetFltLinuxNotifierCallback.
+ * Looks up the instance for an interface name.
+ *
+ * The caller holds the RTNL, which keeps the instance from being unhashed
+ * and freed after we've left the RCU read side section.
+ *
+ * @returns The instance, NULL if not found.
+ * @param   pszName             The interface name.
+ */
+static PVBOXNETFLTINS vboxNetFltLinuxFindByName(const char *pszName)
+{
+    PVBOXNETFLTINS      pRet = NULL;
+    struct hlist_node  *pNode;
+
+    rcu_read_lock();
+    for (pNode = rcu_dereference(g_aNameHash[IntNetNameHash(pszName) & (VBOXNETFLT_NAME_HASH_SIZE - 1)].first);
+         pNode;
+         pNode = rcu_dereference(pNode->next))
+        if (!strcmp(VBOX_FLT_NAME_TO_INST(pNode)->szName, pszName))
+        {
+            pRet = VBOX_FLT_NAME_TO_INST(pNode);
+            break;
+        }
+    rcu_read_unlock();
+    return pRet;
+}
+
+/**
+ * Looks up the instance attached to a device.
+ *
+ * The caller holds the RTNL, see vboxNetFltLinuxFindByName.
+ *
+ * @returns The instance, NULL if not found.
+ * @param   pDev                The device.
+ */
+static PVBOXNETFLTINS vboxNetFltLinuxFindByDev(struct net_device *pDev)
+{
+    PVBOXNETFLTINS      pRet = NULL;
+    struct hlist_node  *pNode;
+
+    rcu_read_lock();
+    for (pNode = rcu_dereference(g_aIfIndexHash[pDev->ifindex & (VBOXNETFLT_LINUX_IFINDEX_HASH_SIZE - 1)].first);
+         pNode;
+         pNode = rcu_dereference(pNode->next))
+        if (   VBOX_FLT_IFINDEX_TO_INST(pNode)->u.s.iIfIndex == pDev->ifindex
+            && ASMAtomicUoReadPtr((void * volatile *)&VBOX_FLT_IFINDEX_TO_INST(pNode)->u.s.pDev) == pDev)
+        {
+            pRet = VBOX_FLT_IFINDEX_TO_INST(pNode);
+            break;
+        }
+    rcu_read_unlock();
+    return pRet;
+}
+
+/**
+ * Unlinks a hash table node if linked, the caller holds the RTNL.
+ *
+ * @param   pNode               The node.
+ */
+static void vboxNetFltLinuxHashDel(struct hlist_node *pNode)
+{
+    if (!hlist_unhashed(pNode))
+    {
+        hlist_del_rcu(pNode);
+        pNode->pprev = NULL; /* leave next alone for concurrent readers */
+    }
+}
+
+/**
+ * Internal worker for vboxNetFltLinuxNotifierCallback and
+ * vboxNetFltOsInitInstance, the caller holds the RTNL.
  *
  * @returns VBox status code.
  * @param   pThis           The instance.
@@ -1356,7 +2498,8 @@ static int vboxNetFltLinuxAttachToInterface(PVBOXNETFLTINS pThis, struct net_dev
     dev_hold(pDev);
 
     RTSpinlockAcquireNoInts(pThis->hSpinlock, &Tmp);
-    ASMAtomicUoWritePtr((void * volatile *)&pThis->u.s.pDev, pDev);
+    /* Published for vboxNetFltLinuxRetainNetDev, which reads it under RCU. */
+    rcu_assign_pointer(*(struct net_device **)&pThis->u.s.pDev, pDev);
     RTSpinlockReleaseNoInts(pThis->hSpinlock, &Tmp);
 
     Log(("vboxNetFltLinuxAttachToInterface: Device %p(%s) retained. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
@@ -1364,6 +2507,7 @@ static int vboxNetFltLinuxAttachToInterface(PVBOXNETFLTINS pThis, struct net_dev
 
     /* Get the mac address while we still have a valid net_device reference. */
     memcpy(&pThis->u.s.MacAddr, pDev->dev_addr, sizeof(pThis->u.s.MacAddr));
+    pThis->u.s.iIfIndex = pDev->ifindex;
 
     /*
      * Install a packet filter for this device with a protocol wildcard (ETH_P_ALL).
@@ -1398,6 +2542,9 @@ static int vboxNetFltLinuxAttachToInterface(PVBOXNETFLTINS pThis, struct net_dev
      */
     if (!pDev)
     {
+        hlist_add_head_rcu(&pThis->u.s.IfIndexNode,
+                           &g_aIfIndexHash[pThis->u.s.iIfIndex & (VBOXNETFLT_LINUX_IFINDEX_HASH_SIZE - 1)]);
+
         Assert(pThis->pSwitchPort);
         if (vboxNetFltTryRetainBusyNotDisconnected(pThis))
         {
@@ -1414,7 +2561,7 @@ static int vboxNetFltLinuxAttachToInterface(PVBOXNETFLTINS pThis, struct net_dev
         vboxNetFltLinuxUnhookDev(pThis, pDev);
 #endif
         RTSpinlockAcquireNoInts(pThis->hSpinlock, &Tmp);
-        ASMAtomicUoWritePtr((void * volatile *)&pThis->u.s.pDev, NULL);
+        RCU_INIT_POINTER(*(struct net_device **)&pThis->u.s.pDev, NULL);
         RTSpinlockReleaseNoInts(pThis->hSpinlock, &Tmp);
         dev_put(pDev);
         Log(("vboxNetFltLinuxAttachToInterface: Device %p(%s) released. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
@@ -1438,13 +2585,17 @@ static int vboxNetFltLinuxUnregisterDevice(PVBOXNETFLTINS pThis, struct net_devi
     RTSpinlockAcquireNoInts(pThis->hSpinlock, &Tmp);
     ASMAtomicWriteBool(&pThis->u.s.fRegistered, false);
     ASMAtomicWriteBool(&pThis->fDisconnectedFromHost, true);
-    ASMAtomicUoWritePtr((void * volatile *)&pThis->u.s.pDev, NULL);
+    RCU_INIT_POINTER(*(struct net_device **)&pThis->u.s.pDev, NULL);
     RTSpinlockReleaseNoInts(pThis->hSpinlock, &Tmp);
 
+    vboxNetFltLinuxHashDel(&pThis->u.s.IfIndexNode);
+    /* This waits for a grace period (synchronize_net), so the transmitters
+       that picked up pDev in vboxNetFltLinuxRetainNetDev are done by the
+       time we drop our reference below. */
     dev_remove_pack(&pThis->u.s.PacketType);
-#ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-    skb_queue_purge(&pThis->u.s.XmitQueue);
-#endif
+    vboxNetFltLinuxRxQueuesPurge(pThis, "unregister");
+    LogRel(("VBoxNetFlt: %s: %llu GSO frames offloaded to the NIC, %llu segmented in software\n",
+            pThis->szName, pThis->u.s.cGsoOffloaded, pThis->u.s.cGsoSwSegmented));
     Log(("vboxNetFltLinuxUnregisterDevice: this=%p: Packet handler removed, xmit queue purged.\n", pThis));
     Log(("vboxNetFltLinuxUnregisterDevice: Device %p(%s) released. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
     dev_put(pDev);
@@ -1512,7 +2663,10 @@ static const char *vboxNetFltLinuxGetNetDevEventName(unsigned long ulEventType)
  * Callback for listening to netdevice events.
  *
  * This works the rediscovery, clean up on unregistration, promiscuity on
- * up/down, and GSO feature changes from ethtool.
+ * up/down, and GSO feature changes from ethtool.  There is one notifier for
+ * all instances, registration events are matched against the instance names
+ * and the others against the attached devices using the hash tables, so the
+ * cost doesn't grow with the number of instances.
  *
  * @returns NOTIFY_OK
  * @param   self                Pointer to our notifier registration block.
@@ -1523,21 +2677,25 @@ static const char *vboxNetFltLinuxGetNetDevEventName(unsigned long ulEventType)
 static int vboxNetFltLinuxNotifierCallback(struct notifier_block *self, unsigned long ulEventType, void *ptr)
 
 {
-    PVBOXNETFLTINS      pThis = VBOX_FLT_NB_TO_INST(self);
     struct net_device  *pDev  = (struct net_device *)ptr;
+    PVBOXNETFLTINS      pThis;
     int                 rc    = NOTIFY_OK;
+    NOREF(self);
 
-    Log(("VBoxNetFlt: got event %s(0x%lx) on %s, pDev=%p pThis=%p pThis->u.s.pDev=%p\n",
-         vboxNetFltLinuxGetNetDevEventName(ulEventType), ulEventType, pDev->name, pDev, pThis, ASMAtomicUoReadPtr((void * volatile *)&pThis->u.s.pDev)));
-    if (    ulEventType == NETDEV_REGISTER
-        && !strcmp(pDev->name, pThis->szName))
+    if (ulEventType == NETDEV_REGISTER)
     {
-        vboxNetFltLinuxAttachToInterface(pThis, pDev);
+        pThis = vboxNetFltLinuxFindByName(pDev->name);
+        Log(("VBoxNetFlt: got event %s(0x%lx) on %s, pDev=%p pThis=%p\n",
+             vboxNetFltLinuxGetNetDevEventName(ulEventType), ulEventType, pDev->name, pDev, pThis));
+        if (pThis && !ASMAtomicUoReadBool(&pThis->u.s.fRegistered))
+            vboxNetFltLinuxAttachToInterface(pThis, pDev);
     }
     else
     {
-        pDev = (struct net_device *)ASMAtomicUoReadPtr((void * volatile *)&pThis->u.s.pDev);
-        if (pDev == ptr)
+        pThis = vboxNetFltLinuxFindByDev(pDev);
+        Log(("VBoxNetFlt: got event %s(0x%lx) on %s, pDev=%p pThis=%p\n",
+             vboxNetFltLinuxGetNetDevEventName(ulEventType), ulEventType, pDev->name, pDev, pThis));
+        if (pThis)
         {
             switch (ulEventType)
             {
@@ -1569,36 +2727,147 @@ bool vboxNetFltOsMaybeRediscovered(PVBOXNETFLTINS pThis)
     return !ASMAtomicUoReadBool(&pThis->fDisconnectedFromHost);
 }
 
+
+/**
+ * Counts a frame we're about to send in the tally of a transmit call.
+ *
+ * @param   pTally              The tally.
+ * @param   pBuf                The socket buffer.
+ */
+DECLINLINE(void) vboxNetFltLinuxTallyTx(PVBOXNETFLTLINUXCOUNTERS pTally, struct sk_buff *pBuf)
+{
+    pTally->cTxPackets++;
+    pTally->cTxBytes += pBuf->len;
+#ifdef VBOXNETFLT_WITH_GSO
+    if (skb_is_gso(pBuf))
+        pTally->cGsoFrames++;
+#endif
+    if (pBuf->ip_summed == CHECKSUM_PARTIAL)
+        pTally->cCsumOffload++;
+}
+
+/**
+ * Adds the tally of a transmit call to the counters of the current CPU.
+ *
+ * @param   pThis               The net filter instance.
+ * @param   pTally              The tally.
+ *
+ * @remarks Must be called with bottom halves disabled, so the packet handler
+ *          can't race us on this CPU's counters.
+ */
+static void vboxNetFltLinuxCommitTallyTx(PVBOXNETFLTINS pThis, PVBOXNETFLTLINUXCOUNTERS pTally)
+{
+    PVBOXNETFLTLINUXCOUNTERS pCounters = &per_cpu_ptr(pThis->u.s.pRxQueues, smp_processor_id())->Counters;
+
+    u64_stats_update_begin(&pCounters->Sync);
+    pCounters->cTxPackets   += pTally->cTxPackets;
+    pCounters->cTxBytes     += pTally->cTxBytes;
+    pCounters->cTxDrops     += pTally->cTxDrops;
+    pCounters->cGsoFrames   += pTally->cGsoFrames;
+    pCounters->cCsumOffload += pTally->cCsumOffload;
+    u64_stats_update_end(&pCounters->Sync);
+}
+
+/**
+ * Creates the wire bound socket buffer(s) for a SG and appends them to a
+ * queue, segmenting GSO frames the NIC cannot offload.
+ *
+ * @returns IPRT status code.
+ * @param   pThis               The net filter instance.
+ * @param   pDev                The retained net device.
+ * @param   pSG                 The (scatter/)gather list.
+ * @param   pWireQueue          The queue to append the socket buffers to.
+ * @param   pTally              The tally to count drops in.
+ */
+static int vboxNetFltLinuxQueueForWire(PVBOXNETFLTINS pThis, struct net_device *pDev, PINTNETSG pSG,
+                                       struct sk_buff_head *pWireQueue, PVBOXNETFLTLINUXCOUNTERS pTally)
+{
+    struct sk_buff *pBuf = vboxNetFltLinuxSkBufFromSG(pThis, pSG, true);
+    NOREF(pDev);
+    if (!pBuf)
+    {
+        pTally->cTxDrops++;
+        return VERR_NO_MEMORY;
+    }
+
+    vboxNetFltDumpPacket(pSG, true, "wire", 1);
+    Log4(("vboxNetFltLinuxQueueForWire: pBuf->cb dump:\n%.*Rhxd\n", sizeof(pBuf->cb), pBuf->cb));
+#ifdef VBOXNETFLT_WITH_GSO_XMIT_WIRE
+    if (   skb_is_gso(pBuf)
+        && !vboxNetFltLinuxCanOffloadGso(pThis, pDev, pSG))
+    {
+        int err;
+        Log4(("vboxNetFltLinuxQueueForWire: segmenting %p\n", pBuf));
+        err = vboxNetFltLinuxSegmentForWire(pThis, pBuf, pWireQueue);
+        if (err)
+        {
+            pTally->cTxDrops++;
+            return RTErrConvertFromErrno(-err);
+        }
+        return VINF_SUCCESS;
+    }
+    if (skb_is_gso(pBuf))
+        ASMAtomicIncU64(&pThis->u.s.cGsoOffloaded);
+#endif
+    __skb_queue_tail(pWireQueue, pBuf);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Pushes the socket buffers of a queue onto the wire.
+ *
+ * @returns IPRT status code of the first frame that failed.
+ * @param   pWireQueue          The queue.  This is emptied.
+ * @param   pTally              The tally.
+ */
+static int vboxNetFltLinuxXmitWireQueue(struct sk_buff_head *pWireQueue, PVBOXNETFLTLINUXCOUNTERS pTally)
+{
+    struct sk_buff *pBuf;
+    int             rc = VINF_SUCCESS;
+
+    while ((pBuf = __skb_dequeue(pWireQueue)) != NULL)
+    {
+        int err;
+        Log4(("vboxNetFltLinuxXmitWireQueue: dev_queue_xmit(%p)\n", pBuf));
+        vboxNetFltLinuxTallyTx(pTally, pBuf);
+        err = dev_queue_xmit(pBuf);
+        if (err)
+        {
+            pTally->cTxDrops++;
+            if (RT_SUCCESS(rc))
+                rc = RTErrConvertFromErrno(err);
+        }
+    }
+    return rc;
+}
+
 int  vboxNetFltPortOsXmit(PVBOXNETFLTINS pThis, void *pvIfData, PINTNETSG pSG, uint32_t fDst)
 {
+    struct net_device  *pDev;
+    struct sk_buff_head WireQueue;
+    int                 err;
+    int                 rc = VINF_SUCCESS;
+    uint64_t const      u64Start = pThis->u.s.pStats ? RTTimeSystemNanoTS() : 0;
+    VBOXNETFLTLINUXCOUNTERS Tally;
     NOREF(pvIfData);
 
-    struct net_device * pDev;
-    int err;
-    int rc = VINF_SUCCESS;
-
     LogFlow(("vboxNetFltPortOsXmit: pThis=%p (%s)\n", pThis, pThis->szName));
 
     pDev = vboxNetFltLinuxRetainNetDev(pThis);
     if (pDev)
     {
+        memset(&Tally, 0, sizeof(Tally));
+
         /*
          * Create a sk_buff for the gather list and push it onto the wire.
          */
         if (fDst & INTNETTRUNKDIR_WIRE)
         {
-            struct sk_buff *pBuf = vboxNetFltLinuxSkBufFromSG(pThis, pSG, true);
-            if (pBuf)
-            {
-                vboxNetFltDumpPacket(pSG, true, "wire", 1);
-                Log4(("vboxNetFltPortOsXmit: pBuf->cb dump:\n%.*Rhxd\n", sizeof(pBuf->cb), pBuf->cb));
-                Log4(("vboxNetFltPortOsXmit: dev_queue_xmit(%p)\n", pBuf));
-                err = dev_queue_xmit(pBuf);
-                if (err)
-                    rc = RTErrConvertFromErrno(err);
-            }
-            else
-                rc = VERR_NO_MEMORY;
+            __skb_queue_head_init(&WireQueue);
+            rc = vboxNetFltLinuxQueueForWire(pThis, pDev, pSG, &WireQueue, &Tally);
+            err = vboxNetFltLinuxXmitWireQueue(&WireQueue, &Tally);
+            if (RT_FAILURE(err) && RT_SUCCESS(rc))
+                rc = err;
         }
 
         /*
@@ -1611,22 +2880,38 @@ int  vboxNetFltPortOsXmit(PVBOXNETFLTINS pThis, void *pvIfData, PINTNETSG pSG, u
             {
                 vboxNetFltDumpPacket(pSG, true, "host", (fDst & INTNETTRUNKDIR_WIRE) ? 0 : 1);
                 Log4(("vboxNetFltPortOsXmit: pBuf->cb dump:\n%.*Rhxd\n", sizeof(pBuf->cb), pBuf->cb));
+                vboxNetFltLinuxTallyTx(&Tally, pBuf);
                 Log4(("vboxNetFltPortOsXmit: netif_rx_ni(%p)\n", pBuf));
                 err = netif_rx_ni(pBuf);
-                if (err)
+                if (err && RT_SUCCESS(rc))
                     rc = RTErrConvertFromErrno(err);
             }
             else
-                rc = VERR_NO_MEMORY;
+            {
+                Tally.cTxDrops++;
+                if (RT_SUCCESS(rc))
+                    rc = VERR_NO_MEMORY;
+            }
         }
 
+        local_bh_disable();
+        vboxNetFltLinuxCommitTallyTx(pThis, &Tally);
+        local_bh_enable();
+
         vboxNetFltLinuxReleaseNetDev(pThis, pDev);
+
+        if (u64Start)
+        {
+            vboxNetFltLinuxHistAdd(per_cpu_ptr(pThis->u.s.pStats, get_cpu())->acXmitLatency, RTTimeSystemNanoTS() - u64Start);
+            put_cpu();
+        }
     }
 
     return rc;
 }
 
 
+
 void vboxNetFltPortOsSetActive(PVBOXNETFLTINS pThis, bool fActive)
 {
     struct net_device * pDev;
@@ -1635,10 +2920,14 @@ void vboxNetFltPortOsSetActive(PVBOXNETFLTINS pThis, bool fActive)
              pThis, pThis->szName, fActive?"true":"false",
              pThis->fDisablePromiscuous?"true":"false"));
 
+    /* Forward the frames the receive queues kept while we were inactive. */
+    if (fActive)
+        vboxNetFltLinuxRxQueuesKick(pThis);
+
     if (pThis->fDisablePromiscuous)
         return;
 
-    pDev = vboxNetFltLinuxRetainNetDev(pThis);
+    pDev = vboxNetFltLinuxHoldNetDev(pThis); /* we take the RTNL below */
     if (pDev)
     {
         /*
@@ -1678,7 +2967,7 @@ void vboxNetFltPortOsSetActive(PVBOXNETFLTINS pThis, bool fActive)
 #endif
         }
 
-        vboxNetFltLinuxReleaseNetDev(pThis, pDev);
+        vboxNetFltLinuxPutNetDev(pThis, pDev);
     }
 }
 
@@ -1715,6 +3004,22 @@ int  vboxNetFltOsConnectIt(PVBOXNETFLTINS pThis)
 }
 
 
+/**
+ * Removes the instance from the hash tables so the notifier no longer sees
+ * it, and waits for the RCU readers.
+ *
+ * @param   pThis               The net filter instance.
+ */
+static void vboxNetFltLinuxUnhash(PVBOXNETFLTINS pThis)
+{
+    rtnl_lock();
+    vboxNetFltLinuxHashDel(&pThis->u.s.NameNode);
+    vboxNetFltLinuxHashDel(&pThis->u.s.IfIndexNode);
+    rtnl_unlock();
+    synchronize_rcu();
+}
+
+
 void vboxNetFltOsDeleteInstance(PVBOXNETFLTINS pThis)
 {
     struct net_device  *pDev;
@@ -1725,10 +3030,12 @@ void vboxNetFltOsDeleteInstance(PVBOXNETFLTINS pThis)
     vboxNetFltLinuxUnhookDev(pThis, NULL);
 #endif
 
-    /** @todo This code may race vboxNetFltLinuxUnregisterDevice (very very
-     *        unlikely, but none the less).  Since it doesn't actually update the
-     *        state (just reads it), it is likely to panic in some interesting
-     *        ways. */
+    /*
+     * Unhash first, the RTNL serializes this with the notifier so
+     * vboxNetFltLinuxUnregisterDevice cannot run for us after this.
+     */
+    vboxNetFltLinuxUnhash(pThis);
+    Log(("vboxNetFltOsDeleteInstance: this=%p: Unhashed.\n", pThis));
 
     RTSpinlockAcquireNoInts(pThis->hSpinlock, &Tmp);
     pDev = (struct net_device *)ASMAtomicUoReadPtr((void * volatile *)&pThis->u.s.pDev);
@@ -1738,40 +3045,61 @@ void vboxNetFltOsDeleteInstance(PVBOXNETFLTINS pThis)
     if (fRegistered)
     {
         dev_remove_pack(&pThis->u.s.PacketType);
-#ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-        skb_queue_purge(&pThis->u.s.XmitQueue);
-#endif
+        vboxNetFltLinuxRxQueuesPurge(pThis, "delete");
+        LogRel(("VBoxNetFlt: %s: %llu GSO frames offloaded to the NIC, %llu segmented in software\n",
+                pThis->szName, pThis->u.s.cGsoOffloaded, pThis->u.s.cGsoSwSegmented));
         Log(("vboxNetFltOsDeleteInstance: this=%p: Packet handler removed, xmit queue purged.\n", pThis));
         Log(("vboxNetFltOsDeleteInstance: Device %p(%s) released. ref=%d\n", pDev, pDev->name, atomic_read(&pDev->refcnt)));
         dev_put(pDev);
     }
-    Log(("vboxNetFltOsDeleteInstance: this=%p: Notifier removed.\n", pThis));
-    unregister_netdevice_notifier(&pThis->u.s.Notifier);
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+    /* The /proc file reads the receive queues, so it must go first. */
+    vboxNetFltLinuxStatsDestroy(pThis);
+#endif
+    vboxNetFltLinuxRxQueuesDestroy(pThis);
     module_put(THIS_MODULE);
 }
 
 
 int  vboxNetFltOsInitInstance(PVBOXNETFLTINS pThis, void *pvContext)
 {
-    int err;
+    struct net_device  *pDev;
+    int                 err;
     NOREF(pvContext);
 
-    pThis->u.s.Notifier.notifier_call = vboxNetFltLinuxNotifierCallback;
-    err = register_netdevice_notifier(&pThis->u.s.Notifier);
-    if (err)
-        return VERR_INTNET_FLT_IF_FAILED;
+    /* The queues must exist before we hook up the packet handler. */
+    err = vboxNetFltLinuxRxQueuesCreate(pThis);
+    if (RT_FAILURE(err))
+        return err;
+
+    /*
+     * Hash the instance by name so the notifier finds it when the device gets
+     * (re-)registered, and attach to the device if it's already there.
+     */
+    rtnl_lock();
+    hlist_add_head_rcu(&pThis->u.s.NameNode,
+                       &g_aNameHash[IntNetNameHash(pThis->szName) & (VBOXNETFLT_NAME_HASH_SIZE - 1)]);
+    pDev = VBOX_DEV_GET_BY_NAME(pThis->szName);
+    if (pDev)
+        vboxNetFltLinuxAttachToInterface(pThis, pDev);
+    rtnl_unlock();
+
     if (!pThis->u.s.fRegistered)
     {
-        unregister_netdevice_notifier(&pThis->u.s.Notifier);
+        vboxNetFltLinuxUnhash(pThis);
+        vboxNetFltLinuxRxQueuesDestroy(pThis);
         LogRel(("VBoxNetFlt: failed to find %s.\n", pThis->szName));
         return VERR_INTNET_FLT_IF_NOT_FOUND;
     }
 
-    Log(("vboxNetFltOsInitInstance: this=%p: Notifier installed.\n", pThis));
+    Log(("vboxNetFltOsInitInstance: this=%p: Hashed and attached.\n", pThis));
     if (   pThis->fDisconnectedFromHost
         || !try_module_get(THIS_MODULE))
         return VERR_INTNET_FLT_IF_FAILED;
 
+#ifdef VBOXNETFLT_WITH_DATAPATH_STATS
+    vboxNetFltLinuxStatsCreate(pThis);
+#endif
     return VINF_SUCCESS;
 }
 
@@ -1784,14 +3112,13 @@ int  vboxNetFltOsPreInitInstance(PVBOXNETFLTINS pThis)
     pThis->u.s.fRegistered = false;
     pThis->u.s.fPromiscuousSet = false;
     memset(&pThis->u.s.PacketType, 0, sizeof(pThis->u.s.PacketType));
-#ifndef VBOXNETFLT_LINUX_NO_XMIT_QUEUE
-    skb_queue_head_init(&pThis->u.s.XmitQueue);
-# if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 20)
-    INIT_WORK(&pThis->u.s.XmitTask, vboxNetFltLinuxXmitTask);
-# else
-    INIT_WORK(&pThis->u.s.XmitTask, vboxNetFltLinuxXmitTask, &pThis->u.s.XmitTask);
-# endif
-#endif
+    INIT_HLIST_NODE(&pThis->u.s.NameNode);
+    INIT_HLIST_NODE(&pThis->u.s.IfIndexNode);
+    pThis->u.s.iIfIndex = 0;
+    pThis->u.s.pRxQueues = NULL;
+    pThis->u.s.pStats = NULL;
+    pThis->u.s.cGsoOffloaded = 0;
+    pThis->u.s.cGsoSwSegmented = 0;
 
     return VINF_SUCCESS;
 }